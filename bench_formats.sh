@@ -0,0 +1,201 @@
+#!/bin/bash
+#
+# Google virtual Ethernet (gve) driver
+#
+# Copyright (C) 2015-2024 Google, Inc.
+#
+# This software is available to you under a choice of one of two licenses. You
+# may choose to be licensed under the terms of the GNU General Public License
+# version 2, as published by the Free Software Foundation, and may be copied,
+# distributed, and modified under those terms. See the GNU General Public
+# License for more details. Otherwise you may choose to be licensed under the
+# terms of the MIT license below.
+#
+# --------------------------------------------------------------------------
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+# Compare the CPU cost of the gve queue formats on one VM. For each format
+# the driver is reloaded with queue_format=N, iperf3 drives TX and RX traffic
+# against a peer, and ethtool/perf counter deltas are reported per packet.
+# Formats the device does not offer fall back to the default format; check
+# the "GVE queue format" line that is printed after each reload.
+
+USAGE=$(cat <<-END
+bench_formats.sh -i=IF -p=PEER [-k=KO] [-F=FORMATS] [-s=SIZES] [-g=GSO] [-f=FLOWS] [-d=SECS]
+    -i=IF or --iface=IF: gve interface to measure.
+    -p=PEER or --peer=PEER: address of a host running "iperf3 -s".
+    -k=KO or --module=KO: gve.ko to load (default: modprobe gve).
+    -F=FORMATS or --formats=FORMATS: comma separated queue formats (1,2,3,4).
+    -s=SIZES or --sizes=SIZES: comma separated write sizes in bytes (1448,65536).
+    -g=GSO or --gso=GSO: comma separated gso_max_size values (65536).
+    -f=FLOWS or --flows=FLOWS: parallel streams per run (8).
+    -d=SECS or --duration=SECS: seconds per run (10).
+END
+)
+
+FORMATS="1,2,3,4"
+SIZES="1448,65536"
+GSOS="65536"
+FLOWS=8
+DURATION=10
+
+for var in "$@"
+do
+case $var in
+ -i=*|--iface=*)
+ IFACE="${var#*=}"
+ ;;
+ -p=*|--peer=*)
+ PEER="${var#*=}"
+ ;;
+ -k=*|--module=*)
+ MODULE="${var#*=}"
+ ;;
+ -F=*|--formats=*)
+ FORMATS="${var#*=}"
+ ;;
+ -s=*|--sizes=*)
+ SIZES="${var#*=}"
+ ;;
+ -g=*|--gso=*)
+ GSOS="${var#*=}"
+ ;;
+ -f=*|--flows=*)
+ FLOWS="${var#*=}"
+ ;;
+ -d=*|--duration=*)
+ DURATION="${var#*=}"
+ ;;
+ *)
+ echo "Unknown option"
+ echo -e "$USAGE"
+ exit 1
+ ;;
+esac
+done
+
+if [ -z "$IFACE" ] || [ -z "$PEER" ]; then
+ echo -e "$USAGE"
+ exit 1
+fi
+
+set -e
+
+for tool in ethtool iperf3 perf ip; do
+ command -v $tool > /dev/null || { echo "$tool is required"; exit 1; }
+done
+
+# Sum every ethtool -S counter whose name matches the regex in $1.
+stat_sum() {
+ ethtool -S "$IFACE" | awk -v re="$1" '
+  { name = $1; sub(":$", "", name) }
+  name ~ re { sum += $2 }
+  END { printf "%d\n", sum }'
+}
+
+# Print the non-idle time of all CPUs in USER_HZ ticks: user, nice, system,
+# irq, softirq and steal from the "cpu" line of /proc/stat.
+busy_ticks() {
+ awk '$1 == "cpu" { print $2 + $3 + $4 + $7 + $8 + $9; exit }' /proc/stat
+}
+
+snapshot() {
+ PKTS=$(( $(stat_sum '^(rx|tx)_packets$') ))
+ FRAG_COPIES=$(( $(stat_sum '^rx_frag_copy_cnt\[') ))
+ COPIED_PKTS=$(( $(stat_sum '^rx_copied_pkt\[') ))
+ COPY_PAGES=$(( $(stat_sum '^rx_frag_alloc_cnt\[') ))
+ BUSY=$(busy_ticks)
+}
+
+# Print the RX copies made between two snapshots. GQI counts every copied
+# segment in rx_frag_copy_cnt, copybreak packets included; those are also in
+# rx_copied_pkt. DQO leaves rx_frag_copy_cnt at 0 and counts copybreak
+# packets in rx_copied_pkt and QPL copies in rx_frag_alloc_cnt.
+copies_between() {
+ local frag_copies=$1 copied_pkts=$2 copy_pages=$3
+
+ if [ "$frag_copies" -gt 0 ]; then
+  echo "$frag_copies"
+ else
+  echo $(( copied_pkts + copy_pages ))
+ fi
+}
+
+load_format() {
+ modprobe -r gve 2> /dev/null || rmmod gve 2> /dev/null || true
+ if [ -n "$MODULE" ]; then
+  insmod "$MODULE" queue_format="$1"
+ else
+  modprobe gve queue_format="$1"
+ fi
+ # Wait for the link to come back before measuring
+ for _ in $(seq 30); do
+  [ "$(cat /sys/class/net/$IFACE/operstate 2> /dev/null)" = "up" ] && break
+  sleep 1
+ done
+ dmesg | grep "GVE queue format" | tail -n 1
+}
+
+# Run iperf3 in direction $1 ("tx" or "rx") with write size $2 under
+# perf stat and print one result row. CPU time is the busy time of all CPUs
+# from /proc/stat; perf stat -a task-clock would count idle time as well.
+run_one() {
+ local dir=$1 size=$2 gso=$3 rev="" perf_out
+ [ "$dir" = "rx" ] && rev="-R"
+
+ snapshot
+ local pkts0=$PKTS frag_copies0=$FRAG_COPIES copied_pkts0=$COPIED_PKTS
+ local copy_pages0=$COPY_PAGES busy0=$BUSY
+ perf_out=$(perf stat -a -x, -e cache-misses -- \
+  iperf3 -c "$PEER" $rev -P "$FLOWS" -l "$size" -t "$DURATION" \
+  2>&1 > /dev/null)
+ snapshot
+
+ local pkts=$(( PKTS - pkts0 ))
+ [ "$pkts" -gt 0 ] || pkts=1
+ local copies=$(copies_between $(( FRAG_COPIES - frag_copies0 )) \
+  $(( COPIED_PKTS - copied_pkts0 )) $(( COPY_PAGES - copy_pages0 )))
+ echo "$perf_out" | awk -F, -v fmt="$FMT" -v dir="$dir" -v size="$size" \
+  -v gso="$gso" -v pkts="$pkts" -v copies="$copies" \
+  -v copy_pages=$(( COPY_PAGES - copy_pages0 )) \
+  -v busy=$(( BUSY - busy0 )) -v hz="$(getconf CLK_TCK)" '
+  $3 == "cache-misses" { misses = $1 }
+  END {
+   printf "%-6s %-3s %7s %7s %12d %10.1f %10.3f %11.3f %10.2f\n",
+    fmt, dir, size, gso, pkts, busy * 1e9 / hz / pkts, copies / pkts,
+    copy_pages / pkts, misses / pkts
+  }'
+}
+
+printf "%-6s %-3s %7s %7s %12s %10s %10s %11s %10s\n" \
+ format dir size gso packets ns/pkt copy/pkt cpypage/pkt miss/pkt
+
+for FMT in ${FORMATS//,/ }; do
+ load_format "$FMT" >&2
+ for gso in ${GSOS//,/ }; do
+  ip link set dev "$IFACE" gso_max_size "$gso"
+  for size in ${SIZES//,/ }; do
+   run_one tx "$size" "$gso"
+   run_one rx "$size" "$gso"
+  done
+ done
+done
@@ -183,6 +183,7 @@ if [ "$TARGET" == "oot" ] || [ "$TARGET" == "cos" ]; then
 fi
 
 if [ "$TARGET" == "oot" ]; then
+ cp "$PATCHDIR"/header/gve_kcompat_gen.sh "$DESTDIR"
  cp "$MAINDIR"/LICENSE "$DESTDIR"/LICENSE
  cp "$MAINDIR"/README.md "$DESTDIR"/README
 fi
@@ -7,6 +7,7 @@
 #ifndef _GVE_H_
 #define _GVE_H_
 
+#include <linux/build_bug.h>
 #include <linux/dma-mapping.h>
 #include <linux/netdevice.h>
 #include <linux/pci.h>
@@ -112,6 +113,11 @@ struct gve_rx_slot_page_info {
 	u8 can_flip; /* tracks if the networking stack is using the page */
 };
 
+#ifdef CONFIG_64BIT
+/* Every field is used per packet: keep two slots to a line, none split */
+static_assert(sizeof(struct gve_rx_slot_page_info) == 32);
+#endif /* CONFIG_64BIT */
+
 /* A list of pages registered with the device during setup and used by a queue
  * as buffers
  */
@@ -199,6 +205,18 @@ struct gve_index_list {
 	s16 tail;
 };
 
+/* Why a packet was dropped, reported through the gve:gve_drop tracepoint */
+enum gve_drop_reason {
+	GVE_DROP_LINEARIZE,
+	GVE_DROP_BAD_GSO,
+	GVE_DROP_DMA_MAP,
+	GVE_DROP_DESC_ERR,
+	GVE_DROP_HSPLIT_OVERFLOW,
+	GVE_DROP_ALLOC_FAIL,
+	GVE_DROP_BAD_BUF_ID,
+	GVE_DROP_COMPL_TIMEOUT,
+};
+
 /* A single received packet split across multiple buffers may be
  * reconstructed using the information in this structure.
  */
@@ -209,19 +227,118 @@ struct gve_rx_ctx {
 	u32 total_size;
 	u8 frag_cnt;
 	bool drop_pkt;
+	bool flow_sort; /* packet is held for flow sorting, not in napi->skb */
+	ktime_t tstamp; /* host time the packet's first completion was read */
+};
+
+/* Pool of DMA-mapped RX pages shared by the DQO RDA rings whose interrupts
+ * are on one NUMA node. Rings holding more pages than they need donate the
+ * surplus and rings that run short borrow from it before allocating.
+ */
+struct gve_rx_node_pool {
+	spinlock_t lock; /* protects everything below */
+	struct page **pages;
+	dma_addr_t *page_buses;
+	u32 count; /* pages currently in the pool */
+	u32 size; /* capacity of pages and page_buses */
+	u64 borrow_cnt; /* pages handed out to rings */
+	u64 donate_cnt; /* pages given back by rings */
+};
+
+/* Pages a ring keeps beyond one per buffer queue slot before donating */
+#define GVE_RX_NODE_POOL_CACHE 64
+
+#define GVE_UDP_GRO_MAX_SEGS 64
+#define GVE_UDP_GRO_MAX_LEN 0xFFFF
+
+/* Driver-side UDP GRO: consecutive equal-sized UDP datagrams of one flow are
+ * chained into a single SKB_GSO_UDP_L4 skb before it is handed to GRO.
+ * Only ever holds an skb within a single poll.
+ */
+struct gve_rx_udp_gro {
+	struct sk_buff *skb; /* aggregate being built, NULL if none */
+	u32 hash; /* RSS hash of the flow */
+	u16 seg_len; /* UDP payload bytes per segment */
+	u16 segs; /* datagrams in skb */
+	u8 l3_type; /* `gve_l3_type` of the flow */
+	bool closed; /* last segment was short, no more appends */
+};
+
+#define GVE_RX_FLOW_SORT_MAX 64
+
+/* Completed skbs of a poll held back so that GRO receives them grouped by
+ * RSS hash. With many interleaved flows this lets same-flow packets merge
+ * instead of evicting each other from the GRO hash.
+ */
+struct gve_rx_flow_sort {
+	struct sk_buff *skbs[GVE_RX_FLOW_SORT_MAX];
+	u16 cnt;
+};
+
+/* Categories of memory used by a queue, reported by ethtool -S */
+enum gve_mem_category {
+	GVE_MEM_DESC,		/* descriptor rings and queue resources */
+	GVE_MEM_DATA,		/* data buffers posted to the device */
+	GVE_MEM_COPY_POOL,	/* GQI-QPL copy pool pages */
+	GVE_MEM_BOOKKEEPING,	/* driver-only per-buffer state */
+	GVE_MEM_PINNED,		/* data pages still referenced by the stack */
+	GVE_MEM_NUM_CATEGORIES,
 };
 
+struct gve_mem_usage {
+	u64 bytes[GVE_MEM_NUM_CATEGORIES];
+};
+
+/* RX ring counters accumulated on the stack during a poll and committed to
+ * the ring in one u64_stats section by gve_rx_commit_cnts().
+ */
 struct gve_rx_cnts {
 	u32 ok_pkt_bytes;
 	u16 ok_pkt_cnt;
 	u16 total_pkt_cnt;
 	u16 cont_pkt_cnt;
 	u16 desc_err_pkt_cnt;
+	u16 hsplit_err_pkt_cnt;
+	u16 skb_alloc_fail_cnt;
+	u16 frag_flip_cnt;
+	u16 frag_copy_cnt;
+	u16 frag_alloc_cnt;
+	u16 copied_pkt_cnt;
+	u16 copybreak_pkt_cnt;
+	u16 udp_gro_pkt_cnt;
+	u16 gro_pkt_cnt;
+	u16 gro_merged_cnt;
+	u16 hsplit_pkt_cnt;
+	u16 hsplit_hbo_pkt_cnt;
+	u32 header_bytes;
+	u16 xdp_tx_errors;
+	u16 xdp_redirect_errors;
+	u16 xdp_alloc_fails;
+	u16 xdp_actions[GVE_XDP_ACTIONS];
+};
+
+/* TX ring counters accumulated on the stack during a poll, see
+ * gve_rx_cnts.
+ */
+struct gve_tx_cnts {
+	u64 bytes_done;
+	u32 pkt_done;
+	u32 xsk_sent;
 };
 
 /* Contains datapath state used to represent an RX queue. */
 struct gve_rx_ring {
+	/* Cacheline 0 -- Accessed & dirtied for every completion */
 	struct gve_priv *gve;
+	u32 cnt; /* free-running total number of completed packets */
+	u32 fill_cnt; /* free-running total number of descs and buffs posted */
+	u32 mask; /* masks the cnt and fill_cnt to the size of the ring */
+	u32 q_num; /* queue index */
+	struct gve_rx_ctx ctx; /* Info for packet currently being processed in this ring. */
+
+	/* Cachelines 0-1 -- Queue state used on every completion or refill,
+	 * followed by DQO fields touched at most once per poll.
+	 */
 	union {
 		/* GQI fields */
 		struct {
@@ -250,6 +367,9 @@ struct gve_rx_ring {
 			 */
 			s16 free_buf_states;
 
+			/* track number of used buffers */
+			u16 used_buf_states_cnt;
+
 			/* Linked list of gve_rx_buf_state_dqo. Indexes into
 			 * buf_states, or -1 if empty.
 			 *
@@ -279,21 +399,35 @@ struct gve_rx_ring {
 			/* index into queue page list */
 			u32 next_qpl_page_idx;
 
-			/* track number of used buffers */
-			u16 used_buf_states_cnt;
+			/* Lowest buffer queue depth seen before a refill in
+			 * the current interval (U32_MAX until the first one),
+			 * and in the last full one.
+			 */
+			u32 bufq_min_depth;
+			u32 bufq_min_depth_last;
+			unsigned long bufq_depth_interval_start; /* jiffies */
+
+			struct gve_rx_udp_gro udp_gro;
+
+			/* Shared page pool of this ring's node, or NULL */
+			struct gve_rx_node_pool *node_pool;
+			/* pages currently attached to buf_states */
+			u32 num_buf_pages;
 		} dqo;
 	};
 
+	/* Warm -- Counters committed once per poll by gve_rx_commit_cnts() */
+	struct u64_stats_sync statss ____cacheline_aligned; /* sync stats for 32bit archs */
 	u64 rbytes; /* free-running bytes received */
 	u64 rheader_bytes; /* free-running header bytes received */
 	u64 rpackets; /* free-running packets received */
-	u32 cnt; /* free-running total number of completed packets */
-	u32 fill_cnt; /* free-running total number of descs and buffs posted */
-	u32 mask; /* masks the cnt and fill_cnt to the size of the ring */
 	u64 rx_hsplit_pkt; /* free-running packets with headers split */
 	u64 rx_hsplit_hbo_pkt; /* free-running packets with header buffer overflow */
 	u64 rx_copybreak_pkt; /* free-running count of copybreak packets */
 	u64 rx_copied_pkt; /* free-running total number of copied packets */
+	u64 rx_udp_gro_pkt; /* free-running datagrams merged by driver UDP GRO */
+	u64 rx_gro_pkt; /* free-running packets handed to GRO */
+	u64 rx_gro_merged_pkt; /* free-running packets GRO merged into another */
 	u64 rx_skb_alloc_fail; /* free-running count of skb alloc fails */
 	u64 rx_buf_alloc_fail; /* free-running count of buffer alloc fails */
 	u64 rx_desc_err_dropped_pkt; /* free-running count of packets dropped by descriptor error */
@@ -302,25 +436,50 @@ struct gve_rx_ring {
 	u64 rx_cont_packet_cnt; /* free-running multi-fragment packets received */
 	u64 rx_frag_flip_cnt; /* free-running count of rx segments where page_flip was used */
 	u64 rx_frag_copy_cnt; /* free-running count of rx segments copied */
-	u64 rx_frag_alloc_cnt; /* free-running count of rx page allocations */
+	u64 rx_frag_alloc_cnt; /* free-running count of copy fallback allocations */
 	u64 xdp_tx_errors;
 	u64 xdp_redirect_errors;
 	u64 xdp_alloc_fails;
 	u64 xdp_actions[GVE_XDP_ACTIONS];
-	u32 q_num; /* queue index */
-	u32 ntfy_id; /* notification block index */
+
+	/* Only touched while the rx-flow-sort flag is on */
+	struct gve_rx_flow_sort flow_sort ____cacheline_aligned;
+
+	/* Slow-path fields */
+	u32 ntfy_id ____cacheline_aligned; /* notification block index */
+	struct gve_rx_ring *ntfy_next; /* next rx ring on the same block */
 	struct gve_queue_resources *q_resources; /* head and tail pointer idx */
 	dma_addr_t q_resources_bus; /* dma address for the queue resources */
-	struct u64_stats_sync statss; /* sync stats for 32bit archs */
-
-	struct gve_rx_ctx ctx; /* Info for packet currently being processed in this ring. */
+	atomic64_t mem_hwm; /* highest total memory usage seen, in bytes */
+	/* ring memory that does not grow with traffic, DQO buffer pages aside */
+	u64 mem_fixed;
 
 	/* XDP stuff */
 	struct xdp_rxq_info xdp_rxq;
 	struct xdp_rxq_info xsk_rxq;
 	struct xsk_buff_pool *xsk_pool;
 	struct page_frag_cache page_cache; /* Page cache to allocate XDP frames */
-};
+} ____cacheline_aligned;
+
+/* Keep the per-completion fields of gve_rx_ring in its first two cachelines
+ * and the per-poll counters, flow sorting and slow-path fields on lines of
+ * their own.
+ */
+static_assert(offsetof(struct gve_rx_ring, ctx) + sizeof(struct gve_rx_ctx) <=
+	      SMP_CACHE_BYTES);
+static_assert(offsetof(struct gve_rx_ring, data) +
+	      sizeof(struct gve_rx_data_queue) <= 2 * SMP_CACHE_BYTES);
+static_assert(offsetof(struct gve_rx_ring, dqo.complq) +
+	      sizeof(struct gve_rx_compl_queue_dqo) <= 2 * SMP_CACHE_BYTES);
+static_assert(offsetof(struct gve_rx_ring, statss) % SMP_CACHE_BYTES == 0);
+static_assert(offsetof(struct gve_rx_ring, flow_sort) % SMP_CACHE_BYTES == 0);
+static_assert(offsetof(struct gve_rx_ring, ntfy_id) % SMP_CACHE_BYTES == 0);
+
+#define GVE_TX_WAKE_THRESH_DEFAULT 25
+#define GVE_TX_WAKE_THRESH_MAX 90
+
+/* Stopped durations of <10us, <100us, <1ms, <10ms and longer */
+#define GVE_TX_STOPPED_HIST_BUCKETS 5
 
 /* A TX desc ring entry */
 union gve_tx_desc {
@@ -353,6 +512,10 @@ struct gve_tx_buffer_state {
 		struct {
 			DEFINE_DMA_UNMAP_ADDR(dma);
 			DEFINE_DMA_UNMAP_LEN(len);
+			/* Entries in this slot's scatterlist if the packet
+			 * was mapped with dma_map_sg, 0 otherwise.
+			 */
+			u8 sg_nents;
 		};
 	};
 };
@@ -407,6 +570,11 @@ struct gve_tx_pending_packet_dqo {
 
 	u16 num_bufs;
 
+	/* Entries in this packet's scatterlist if it was mapped with
+	 * dma_map_sg, in which case dma/len are unused. 0 otherwise.
+	 */
+	u8 sg_nents;
+
 	/* Linked list index to next element in the list, or -1 if none */
 	s16 next;
 
@@ -496,6 +664,8 @@ struct gve_tx_ring {
 			spinlock_t clean_lock;
 			/* Spinlock for XDP tx traffic */
 			spinlock_t xdp_lock;
+			/* Last event counter value read under clean_lock */
+			u32 nic_done_cache;
 		};
 
 		/* DQO fields. */
@@ -604,7 +774,16 @@ struct gve_tx_ring {
 	u32 stop_queue; /* count of queue stops */
 	u32 wake_queue; /* count of queue wakes */
 	u32 queue_timeout; /* count of queue timeouts */
+	u32 compl_deferred; /* count of GQI polls that left completions behind */
+	u64 stop_start_ns; /* local_clock() when the queue was last stopped */
+	/* wakes counted by how long the queue had been stopped */
+	u32 stopped_hist[GVE_TX_STOPPED_HIST_BUCKETS];
+	/* GVE_TX_SG_MAX_ENTS entries per GQI info slot or DQO pending packet,
+	 * only allocated on RDA rings when tx_sg_map is set.
+	 */
+	struct scatterlist *sgl;
 	u32 ntfy_id; /* notification block index */
+	struct gve_tx_ring *ntfy_next; /* next tx ring on the same block */
 	u32 last_kick_msec; /* Last time the queue was kicked */
 	dma_addr_t bus; /* dma address of the descr ring */
 	dma_addr_t q_resources_bus; /* dma address of the queue resources */
@@ -616,10 +795,12 @@ struct gve_tx_ring {
 	u64 xdp_xsk_sent;
 	u64 xdp_xmit;
 	u64 xdp_xmit_errors;
+	atomic64_t mem_hwm; /* highest total memory usage seen, in bytes */
 } ____cacheline_aligned;
 
 /* Wraps the info for one irq including the napi struct and the queues
- * associated with that irq.
+ * associated with that irq. When there are fewer irqs than queues, several
+ * queues share a block and are chained through their ntfy_next pointers.
  */
 struct gve_notify_block {
 	__be32 *irq_db_index; /* pointer to idx into Bar2 */
@@ -628,8 +809,37 @@ struct gve_notify_block {
 	struct gve_priv *priv;
 	struct gve_tx_ring *tx; /* tx rings on this block */
 	struct gve_rx_ring *rx; /* rx rings on this block */
+	u16 num_tx; /* number of tx rings on this block */
+	u16 num_rx; /* number of rx rings on this block */
+	u16 rx_start; /* rx ring the next gve_napi_poll_rx() starts at */
+	int irq_cpu; /* CPU the irq is affine to */
+	int node; /* NUMA node of irq_cpu */
+	u64 tx_budget_exhausted; /* polls cut short by pending tx completions */
+	u64 rx_budget_exhausted; /* polls cut short by the rx budget */
+	u64 time_budget_exhausted; /* polls cut short by the time limit */
+
+	/* Polled mode: the irq stays masked and poll_task, bound to irq_cpu,
+	 * schedules NAPI itself.
+	 */
+	bool polled;
+	struct task_struct *poll_task;
+	u64 poll_busy_ns; /* time spent in polls that found work */
+	u64 poll_run_ns; /* total time poll_task has been running its loop */
 };
 
+/* Idle loops a polling thread spins through before it starts sleeping, and
+ * the range its sleep backs off over while the block stays idle.
+ */
+#define GVE_POLL_IDLE_SPINS 64
+#define GVE_POLL_SLEEP_MIN_US 10
+#define GVE_POLL_SLEEP_MAX_US 1000
+
+/* Scatterlist entries a TX packet can need: the linear head and each frag */
+#define GVE_TX_SG_MAX_ENTS (MAX_SKB_FRAGS + 1)
+
+/* Upper bound for the GQI tx completion threshold, tx_max_coalesced_frames */
+#define GVE_TX_COMPL_THRESH_MAX_GQI NAPI_POLL_WEIGHT
+
 /* Tracks allowed and current queue settings */
 struct gve_queue_config {
 	u16 max_queues;
@@ -698,6 +908,8 @@ struct gve_flow_spec {
 
 struct gve_flow_rule {
 	struct list_head list;
+	u32 id; /* distinguishes rules reusing the same loc */
+	bool del_pending; /* delete queued, not yet acked by the device */
 	u16 loc;
 	u16 flow_type;
 	u16 action;
@@ -705,6 +917,21 @@ struct gve_flow_rule {
 	struct gve_flow_spec mask;
 };
 
+struct devlink;
+struct devlink_health_reporter;
+
+/* A devlink health reporter and the context of its last report, see
+ * gve_devlink.c
+ */
+struct gve_health_reporter {
+	struct gve_priv *priv;
+	struct devlink_health_reporter *reporter;
+	struct work_struct report_task; /* reports from atomic context */
+	const char *msg; /* message of the last report */
+	int qid; /* queue of the last report, -1 if not queue specific */
+	bool reset; /* the last report needs a reset to recover */
+};
+
 struct gve_priv {
 	struct net_device *dev;
 	struct gve_tx_ring *tx; /* array of tx_cfg.num_queues */
@@ -734,10 +961,18 @@ struct gve_priv {
 	bool modify_ringsize_enabled;
 
 	u16 num_xdp_queues;
+	/* XDP tx rings share their rx ring's notify block. Latched from the
+	 * xdp-tx-colocate flag whenever the XDP rings are set up.
+	 */
+	bool xdp_tx_colocate;
 	struct gve_queue_config tx_cfg;
 	struct gve_queue_config rx_cfg;
 	struct gve_qpl_config qpl_cfg; /* map used QPL ids */
-	u32 num_ntfy_blks; /* spilt between TX and RX so must be even */
+	u32 num_ntfy_blks; /* spilt between TX and RX */
+	/* Blocks [0, ntfy_tx_blks) serve TX, the rest RX. Set from the
+	 * queue counts at each open.
+	 */
+	u32 ntfy_tx_blks;
 
 	struct gve_registers __iomem *reg_bar0; /* see gve_register.h */
 	__be32 __iomem *db_bar2; /* "array" of doorbells */
@@ -771,6 +1006,18 @@ struct gve_priv {
 	u32 adminq_verify_driver_compatibility_cnt;
 	u32 adminq_cfg_flow_rule_cnt;
 	u32 adminq_cfg_rss_cnt;
+	u32 adminq_async_cmd_cnt; /* free-running count of async AQ cmds run */
+	u32 adminq_async_cmd_fail; /* free-running count of async AQ cmds failed */
+
+	/* Serializes use of the admin queue ring between synchronous callers
+	 * and the async executor.
+	 */
+	struct mutex adminq_lock;
+	/* Async admin command executor - see gve_adminq_async_submit() */
+	struct work_struct adminq_async_task;
+	struct mutex adminq_async_run_lock; /* one runner at a time, in order */
+	spinlock_t adminq_async_lock; /* protects adminq_async_cmds */
+	struct list_head adminq_async_cmds;
 
 	/* Global stats */
 	u32 interface_up_cnt; /* count of times interface turned up since last reset */
@@ -781,9 +1028,26 @@ struct gve_priv {
 	u32 stats_report_trigger_cnt; /* count of device-requested stats-reports since last reset */
 	u32 suspend_cnt; /* count of times suspended */
 	u32 resume_cnt; /* count of times resumed */
+	atomic64_t mem_hwm; /* highest total queue memory usage seen, in bytes */
+	/* Queue memory when the rings were last set up, less the DQO RDA
+	 * buffer pages allocated up to then; rx_buf_pages counts those pages,
+	 * net of frees, so the two add up to the current total.
+	 */
+	s64 mem_fixed;
+	atomic64_t rx_buf_pages;
 	struct workqueue_struct *gve_wq;
 	struct work_struct service_task;
 	struct work_struct stats_report_task;
+
+	/* QPLs are allocated in the background at probe so the first open
+	 * can use them. They are only kept if their queue and page counts
+	 * still fit the queue config when the device opens.
+	 */
+	struct work_struct qpl_prealloc_task;
+	bool qpls_preallocated;
+	u64 qpl_prealloc_us; /* time the background QPL allocation took */
+	ktime_t probe_start;
+	bool first_open_done; /* time to the first open has been reported */
 	unsigned long service_task_flags;
 	unsigned long state_flags;
 
@@ -811,10 +1075,56 @@ struct gve_priv {
 	int dev_max_rx_buffer_size; /* The max rx buffer size that device support*/
 
 	enum gve_queue_format queue_format;
+	/* Format requested with the queue_format module parameter, used when
+	 * the device offers it. UNSPECIFIED keeps the default priority order.
+	 */
+	enum gve_queue_format queue_format_pref;
+
+	/* Set by the rx_node_pool module parameter. DQO RDA rings then share
+	 * spare pages through a pool per NUMA node, indexed by node id.
+	 */
+	bool rx_node_pool_enabled;
+	struct gve_rx_node_pool **rx_node_pools;
+
+	/* Confidential VM mode, from the cvm_mode module parameter. QPL
+	 * formats are preferred and QPL pages come from memory already shared
+	 * with the host, so the driver's own copy is the only one and nothing
+	 * bounces through swiotlb.
+	 */
+	bool cvm_mode;
+
+	/* Set by the tx_sg_map module parameter. RDA TX rings then map each
+	 * packet as one scatterlist instead of one mapping per buffer.
+	 */
+	bool tx_sg_map;
+
+	/* Queues whose notify blocks run in polled mode, set through the
+	 * polled_queues devlink param. Sized for max(tx, rx) max_queues.
+	 */
+	unsigned long *polled_queues;
+	u16 polled_queues_nbits;
 
 	/* Interrupt coalescing settings */
 	u32 tx_coalesce_usecs;
 	u32 rx_coalesce_usecs;
+	/* GQI: polls leave fewer than this many tx completions for later
+	 * while more packets are in flight. 0 cleans on every poll.
+	 */
+	u32 tx_compl_thresh_gqi;
+
+	/* Per-ring work done in each round of the DQO NAPI poll */
+	u32 napi_tx_weight_dqo;
+	u32 napi_rx_weight_dqo;
+
+	/* Percent of a stopped TX queue's descriptors, and FIFO or QPL
+	 * buffers, that must be free before it is woken. 0 wakes as soon
+	 * as one packet fits.
+	 */
+	u32 tx_wake_thresh_gqi;
+	u32 tx_wake_thresh_dqo;
+
+	/* Stamp RX skbs with the time their completion was read */
+	bool rx_tstamp_enabled;
 
 	/* The size of buffers to allocate for the headers.
 	 * A non-zero value enables header-split.
@@ -828,11 +1138,22 @@ struct gve_priv {
 	 */
 	u16 flow_rules_max;
 	u16 flow_rules_cnt;
+	u32 flow_rules_next_id;
 	struct list_head flow_rules;
-	spinlock_t flow_rules_lock;
+	/* Protects flow_rules; taken by async completions, never held across
+	 * an admin command.
+	 */
+	struct mutex flow_rules_lock;
 
-	/* RSS configuration */
+	/* RSS configuration, as last acked by the device */
 	struct gve_rss_config rss_config;
+	struct mutex rss_config_lock; /* protects rss_config */
+
+	/* devlink instance and health reporters */
+	struct devlink *devlink;
+	struct gve_health_reporter tx_health;
+	struct gve_health_reporter rx_health;
+	struct gve_health_reporter adminq_health;
 };
 
 enum gve_service_task_flags_bit {
@@ -854,13 +1175,23 @@ enum gve_ethtool_flags_bit {
 	GVE_PRIV_FLAGS_ENABLE_HEADER_SPLIT	= 1,
 	GVE_PRIV_FLAGS_ENABLE_STRICT_HEADER_SPLIT = 2,
 	GVE_PRIV_FLAGS_ENABLE_MAX_RX_BUFFER_SIZE = 3,
+	GVE_PRIV_FLAGS_RX_TSTAMP_PER_PKT	= 4,
+	GVE_PRIV_FLAGS_UDP_GRO			= 5,
+	GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED	= 6,
+	GVE_PRIV_FLAGS_RX_FLOW_SORT		= 7,
+	GVE_PRIV_FLAGS_XDP_TX_COLOCATE		= 8,
 };
 
 #define GVE_PRIV_FLAGS_MASK \
 	(BIT(GVE_PRIV_FLAGS_REPORT_STATS)		| \
 	 BIT(GVE_PRIV_FLAGS_ENABLE_HEADER_SPLIT)	| \
 	 BIT(GVE_PRIV_FLAGS_ENABLE_STRICT_HEADER_SPLIT)		| \
-	 BIT(GVE_PRIV_FLAGS_ENABLE_MAX_RX_BUFFER_SIZE))
+	 BIT(GVE_PRIV_FLAGS_ENABLE_MAX_RX_BUFFER_SIZE) | \
+	 BIT(GVE_PRIV_FLAGS_RX_TSTAMP_PER_PKT)	| \
+	 BIT(GVE_PRIV_FLAGS_UDP_GRO)		| \
+	 BIT(GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED)	| \
+	 BIT(GVE_PRIV_FLAGS_RX_FLOW_SORT)		| \
+	 BIT(GVE_PRIV_FLAGS_XDP_TX_COLOCATE))
 
 static inline bool gve_get_do_reset(struct gve_priv *priv)
 {
@@ -1005,6 +1336,31 @@ static inline bool gve_get_enable_max_rx_buffer_size(struct gve_priv *priv)
 	return test_bit(GVE_PRIV_FLAGS_ENABLE_MAX_RX_BUFFER_SIZE, &priv->ethtool_flags);
 }
 
+static inline bool gve_get_rx_tstamp_per_pkt(struct gve_priv *priv)
+{
+	return test_bit(GVE_PRIV_FLAGS_RX_TSTAMP_PER_PKT, &priv->ethtool_flags);
+}
+
+static inline bool gve_get_udp_gro(struct gve_priv *priv)
+{
+	return test_bit(GVE_PRIV_FLAGS_UDP_GRO, &priv->ethtool_flags);
+}
+
+static inline bool gve_get_hsplit_page_aligned(struct gve_priv *priv)
+{
+	return test_bit(GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED, &priv->ethtool_flags);
+}
+
+static inline bool gve_get_rx_flow_sort(struct gve_priv *priv)
+{
+	return test_bit(GVE_PRIV_FLAGS_RX_FLOW_SORT, &priv->ethtool_flags);
+}
+
+static inline bool gve_get_xdp_tx_colocate(struct gve_priv *priv)
+{
+	return test_bit(GVE_PRIV_FLAGS_XDP_TX_COLOCATE, &priv->ethtool_flags);
+}
+
 /* Returns the address of the ntfy_blocks irq doorbell
  */
 static inline __be32 __iomem *gve_irq_doorbell(struct gve_priv *priv,
@@ -1013,18 +1369,57 @@ static inline __be32 __iomem *gve_irq_doorbell(struct gve_priv *priv,
 	return &priv->db_bar2[be32_to_cpu(*block->irq_db_index)];
 }
 
-/* Returns the index into ntfy_blocks of the given tx ring's block
+/* Returns the number of ntfy_blocks set aside for rx rings
  */
-static inline u32 gve_tx_idx_to_ntfy(struct gve_priv *priv, u32 queue_idx)
+static inline u32 gve_ntfy_rx_blks(struct gve_priv *priv)
 {
-	return queue_idx;
+	return priv->num_ntfy_blks - priv->ntfy_tx_blks;
 }
 
 /* Returns the index into ntfy_blocks of the given rx ring's block
  */
 static inline u32 gve_rx_idx_to_ntfy(struct gve_priv *priv, u32 queue_idx)
 {
-	return (priv->num_ntfy_blks / 2) + queue_idx;
+	return priv->ntfy_tx_blks + queue_idx % gve_ntfy_rx_blks(priv);
+}
+
+static inline bool gve_xdp_tx_colocated(struct gve_priv *priv)
+{
+	return priv->num_xdp_queues && priv->xdp_tx_colocate;
+}
+
+/* Returns the index into ntfy_blocks of the given tx ring's block. A
+ * colocated XDP tx ring uses the block of the rx ring that feeds it.
+ */
+static inline u32 gve_tx_idx_to_ntfy(struct gve_priv *priv, u32 queue_idx)
+{
+	if (queue_idx >= priv->tx_cfg.num_queues && gve_xdp_tx_colocated(priv))
+		return gve_rx_idx_to_ntfy(priv,
+					  queue_idx - priv->tx_cfg.num_queues);
+	return queue_idx % priv->ntfy_tx_blks;
+}
+
+/* Returns the number of tx rings that are spread over the tx ntfy_blocks
+ */
+static inline u32 gve_num_tx_ntfy_queues(struct gve_priv *priv)
+{
+	if (gve_xdp_tx_colocated(priv))
+		return priv->tx_cfg.num_queues;
+	return priv->tx_cfg.num_queues + priv->num_xdp_queues;
+}
+
+/* Returns the number of ntfy_blocks that carry at least one tx ring
+ */
+static inline u32 gve_num_tx_ntfy_blks(struct gve_priv *priv, u32 num_tx)
+{
+	return min_t(u32, num_tx, priv->ntfy_tx_blks);
+}
+
+/* Returns the number of ntfy_blocks that carry at least one rx ring
+ */
+static inline u32 gve_num_rx_ntfy_blks(struct gve_priv *priv, u32 num_rx)
+{
+	return min_t(u32, num_rx, gve_ntfy_rx_blks(priv));
 }
 
 static inline bool gve_is_qpl(struct gve_priv *priv)
@@ -1165,20 +1560,40 @@ int gve_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **frames,
 int gve_xdp_xmit_one(struct gve_priv *priv, struct gve_tx_ring *tx,
 		     void *data, int len, void *frame_p);
 void gve_xdp_tx_flush(struct gve_priv *priv, u32 xdp_qid);
-bool gve_tx_poll(struct gve_notify_block *block, int budget);
-bool gve_xdp_poll(struct gve_notify_block *block, int budget);
+bool gve_tx_poll(struct gve_notify_block *block, struct gve_tx_ring *tx,
+		 int budget);
+bool gve_xdp_poll(struct gve_notify_block *block, struct gve_tx_ring *tx,
+		  int budget);
 int gve_tx_alloc_rings(struct gve_priv *priv, int start_id, int num_rings);
 void gve_tx_free_rings_gqi(struct gve_priv *priv, int start_id, int num_rings);
 u32 gve_tx_load_event_counter(struct gve_priv *priv,
 			      struct gve_tx_ring *tx);
 bool gve_tx_clean_pending(struct gve_priv *priv, struct gve_tx_ring *tx);
+void gve_tx_get_mem_usage(struct gve_tx_ring *tx, struct gve_mem_usage *usage);
 /* rx handling */
 void gve_rx_write_doorbell(struct gve_priv *priv, struct gve_rx_ring *rx);
-int gve_rx_poll(struct gve_notify_block *block, int budget);
+int gve_rx_poll(struct gve_notify_block *block, struct gve_rx_ring *rx,
+		int budget);
 bool gve_rx_work_pending(struct gve_rx_ring *rx);
 int gve_rx_alloc_rings(struct gve_priv *priv);
 void gve_rx_free_rings_gqi(struct gve_priv *priv);
 int gve_recreate_rx_rings(struct gve_priv *priv);
+void gve_rx_get_mem_usage(struct gve_rx_ring *rx, struct gve_mem_usage *usage);
+void gve_update_mem_hwm(struct gve_priv *priv);
+
+/* Raise the high-water mark at @hwm to @bytes if that is higher. */
+static inline void gve_mem_hwm_raise(atomic64_t *hwm, u64 bytes)
+{
+	s64 old = atomic64_read(hwm);
+
+	while ((s64)bytes > old) {
+		s64 prev = atomic64_cmpxchg(hwm, old, bytes);
+
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
 int gve_reconfigure_rx_rings(struct gve_priv *priv,
                              bool enable_hdr_split,
                              int packet_buffer_size);
@@ -1188,14 +1603,29 @@ int gve_reset(struct gve_priv *priv, bool attempt_teardown);
 int gve_adjust_queues(struct gve_priv *priv,
 		      struct gve_queue_config new_rx_config,
 		      struct gve_queue_config new_tx_config);
+void gve_qpl_prealloc_flush(struct gve_priv *priv);
 int gve_flow_rules_reset(struct gve_priv *priv);
 
+/* Polled mode */
+void gve_polled_update(struct gve_priv *priv);
+
+/* devlink health */
+int gve_devlink_register(struct gve_priv *priv);
+void gve_devlink_unregister(struct gve_priv *priv);
+void gve_health_report_tx_timeout(struct gve_priv *priv, int qid);
+void gve_health_report_rx_err(struct gve_priv *priv, int qid,
+			      const char *msg);
+void gve_health_report_adminq_timeout(struct gve_priv *priv);
+
 /* report stats handling */
 void gve_handle_report_stats(struct gve_priv *priv);
 
 /* RSS support */
 int gve_rss_config_init(struct gve_priv *priv);
-void gve_rss_set_default_indir(struct gve_priv *priv);
+void gve_rss_set_default_indir(struct gve_priv *priv,
+			       struct gve_rss_config *rss_config);
+void gve_rss_config_commit(struct gve_priv *priv,
+			   struct gve_rss_config *rss_config);
 void gve_rss_config_release(struct gve_rss_config *rss_config);
 
 int gve_adjust_ring_sizes(struct gve_priv *priv,
@@ -279,6 +279,8 @@ int gve_adminq_alloc(struct device *dev, struct gve_priv *priv)
 	priv->adminq_report_link_speed_cnt = 0;
 	priv->adminq_get_ptype_map_cnt = 0;
 	priv->adminq_cfg_flow_rule_cnt = 0;
+	priv->adminq_async_cmd_cnt = 0;
+	priv->adminq_async_cmd_fail = 0;
 
 	/* Setup Admin queue with the device */
 	iowrite32be(priv->adminq_bus_addr / PAGE_SIZE,
@@ -314,8 +316,73 @@ void gve_adminq_free(struct device *dev, struct gve_priv *priv)
 	if (!gve_get_admin_queue_ok(priv))
 		return;
 	gve_adminq_release(priv);
-	dma_free_coherent(dev, PAGE_SIZE, priv->adminq, priv->adminq_bus_addr);
 	gve_clear_admin_queue_ok(priv);
+	/* Let health dumps that saw admin_queue_ok finish with the queue */
+	synchronize_rcu();
+	dma_free_coherent(dev, PAGE_SIZE, priv->adminq, priv->adminq_bus_addr);
+}
+
+/* Queue a command for the async executor. The caller does not wait for the
+ * device; cmd->done runs from the executor once the command completes.
+ */
+void gve_adminq_async_submit(struct gve_priv *priv,
+			     struct gve_adminq_async_cmd *cmd)
+{
+	spin_lock_bh(&priv->adminq_async_lock);
+	list_add_tail(&cmd->list, &priv->adminq_async_cmds);
+	spin_unlock_bh(&priv->adminq_async_lock);
+
+	queue_work(priv->gve_wq, &priv->adminq_async_task);
+}
+
+/* Run every queued async command in submission order. Called from the
+ * executor work item, and inline by synchronous paths that must not be
+ * overtaken by earlier async commands (e.g. a flow rule reset).
+ */
+void gve_adminq_async_drain(struct gve_priv *priv)
+{
+	struct gve_adminq_async_cmd *cmd;
+	int err;
+
+	mutex_lock(&priv->adminq_async_run_lock);
+	for (;;) {
+		spin_lock_bh(&priv->adminq_async_lock);
+		cmd = list_first_entry_or_null(&priv->adminq_async_cmds,
+					       struct gve_adminq_async_cmd,
+					       list);
+		if (cmd)
+			list_del(&cmd->list);
+		spin_unlock_bh(&priv->adminq_async_lock);
+		if (!cmd)
+			break;
+
+		if (gve_get_admin_queue_ok(priv))
+			err = cmd->exec(priv, cmd);
+		else
+			err = -ENODEV;
+		priv->adminq_async_cmd_cnt++;
+		if (err)
+			priv->adminq_async_cmd_fail++;
+		cmd->done(priv, cmd, err);
+	}
+	mutex_unlock(&priv->adminq_async_run_lock);
+}
+
+static void gve_adminq_async_task(struct work_struct *work)
+{
+	struct gve_priv *priv = container_of(work, struct gve_priv,
+					     adminq_async_task);
+
+	gve_adminq_async_drain(priv);
+}
+
+void gve_adminq_async_init(struct gve_priv *priv)
+{
+	mutex_init(&priv->adminq_lock);
+	mutex_init(&priv->adminq_async_run_lock);
+	spin_lock_init(&priv->adminq_async_lock);
+	INIT_LIST_HEAD(&priv->adminq_async_cmds);
+	INIT_WORK(&priv->adminq_async_task, gve_adminq_async_task);
 }
 
 static void gve_adminq_kick_cmd(struct gve_priv *priv, u32 prod_cnt)
@@ -393,6 +460,7 @@ static int gve_adminq_kick_and_wait(struct gve_priv *priv)
 	if (!gve_adminq_wait_for_cmd(priv, head)) {
 		dev_err(&priv->pdev->dev, "AQ commands timed out, need to reset AQ\n");
 		priv->adminq_timeouts++;
+		gve_health_report_adminq_timeout(priv);
 		return -ENOTRECOVERABLE;
 	}
 
@@ -507,10 +575,8 @@ static int gve_adminq_issue_cmd(struct gve_priv *priv,
 	return 0;
 }
 
-/* This function is not threadsafe - the caller is responsible for any
- * necessary locks.
- * The caller is also responsible for making sure there are no commands
- * waiting to be executed.
+/* Takes adminq_lock, so commands issued from the async executor and from
+ * synchronous callers never interleave on the ring.
  */
 static int gve_adminq_execute_cmd(struct gve_priv *priv,
 				  union gve_adminq_command *cmd_orig)
@@ -518,17 +584,23 @@ static int gve_adminq_execute_cmd(struct gve_priv *priv,
 	u32 tail, head;
 	int err;
 
+	mutex_lock(&priv->adminq_lock);
 	tail = ioread32be(&priv->reg_bar0->adminq_event_counter);
 	head = priv->adminq_prod_cnt;
-	if (tail != head)
+	if (tail != head) {
 		// This is not a valid path
-		return -EINVAL;
+		err = -EINVAL;
+		goto out;
+	}
 
 	err = gve_adminq_issue_cmd(priv, cmd_orig);
 	if (err)
-		return err;
+		goto out;
 
-	return gve_adminq_kick_and_wait(priv);
+	err = gve_adminq_kick_and_wait(priv);
+out:
+	mutex_unlock(&priv->adminq_lock);
+	return err;
 }
 
 static int gve_adminq_execute_extended_cmd(struct gve_priv *priv,
@@ -652,13 +724,17 @@ int gve_adminq_create_tx_queues(struct gve_priv *priv, u32 start_id, u32 num_que
 	int err;
 	int i;
 
+	mutex_lock(&priv->adminq_lock);
 	for (i = start_id; i < start_id + num_queues; i++) {
 		err = gve_adminq_create_tx_queue(priv, i);
 		if (err)
-			return err;
+			goto out;
 	}
 
-	return gve_adminq_kick_and_wait(priv);
+	err = gve_adminq_kick_and_wait(priv);
+out:
+	mutex_unlock(&priv->adminq_lock);
+	return err;
 }
 
 static int gve_adminq_create_rx_queue(struct gve_priv *priv, u32 queue_index)
@@ -718,13 +794,17 @@ int gve_adminq_create_rx_queues(struct gve_priv *priv, u32 num_queues)
 	int err;
 	int i;
 
+	mutex_lock(&priv->adminq_lock);
 	for (i = 0; i < num_queues; i++) {
 		err = gve_adminq_create_rx_queue(priv, i);
 		if (err)
-			return err;
+			goto out;
 	}
 
-	return gve_adminq_kick_and_wait(priv);
+	err = gve_adminq_kick_and_wait(priv);
+out:
+	mutex_unlock(&priv->adminq_lock);
+	return err;
 }
 
 static int gve_adminq_destroy_tx_queue(struct gve_priv *priv, u32 queue_index)
@@ -750,13 +830,17 @@ int gve_adminq_destroy_tx_queues(struct gve_priv *priv, u32 start_id, u32 num_qu
 	int err;
 	int i;
 
+	mutex_lock(&priv->adminq_lock);
 	for (i = start_id; i < start_id + num_queues; i++) {
 		err = gve_adminq_destroy_tx_queue(priv, i);
 		if (err)
-			return err;
+			goto out;
 	}
 
-	return gve_adminq_kick_and_wait(priv);
+	err = gve_adminq_kick_and_wait(priv);
+out:
+	mutex_unlock(&priv->adminq_lock);
+	return err;
 }
 
 static int gve_adminq_destroy_rx_queue(struct gve_priv *priv, u32 queue_index)
@@ -782,13 +866,17 @@ int gve_adminq_destroy_rx_queues(struct gve_priv *priv, u32 num_queues)
 	int err;
 	int i;
 
+	mutex_lock(&priv->adminq_lock);
 	for (i = 0; i < num_queues; i++) {
 		err = gve_adminq_destroy_rx_queue(priv, i);
 		if (err)
-			return err;
+			goto out;
 	}
 
-	return gve_adminq_kick_and_wait(priv);
+	err = gve_adminq_kick_and_wait(priv);
+out:
+	mutex_unlock(&priv->adminq_lock);
+	return err;
 }
 
 static int gve_set_desc_cnt(struct gve_priv *priv,
@@ -909,6 +997,66 @@ static void gve_enable_supported_features(
 	}
 }
 
+/* Honour queue_format_pref by hiding the options that would otherwise win
+ * the priority order below. A preference the device does not offer is
+ * ignored.
+ */
+static void
+gve_apply_queue_format_pref(struct gve_priv *priv,
+			    struct gve_device_option_gqi_rda **dev_op_gqi_rda,
+			    struct gve_device_option_dqo_rda **dev_op_dqo_rda,
+			    struct gve_device_option_dqo_qpl **dev_op_dqo_qpl)
+{
+	bool offered;
+
+	/* RDA buffers of a confidential VM all bounce through swiotlb, so
+	 * unless a format was asked for, fall back to DQO QPL or GQI QPL.
+	 */
+	if (priv->cvm_mode &&
+	    priv->queue_format_pref == GVE_QUEUE_FORMAT_UNSPECIFIED) {
+		*dev_op_dqo_rda = NULL;
+		*dev_op_gqi_rda = NULL;
+		if (priv->queue_format == GVE_GQI_RDA_FORMAT)
+			priv->queue_format = GVE_QUEUE_FORMAT_UNSPECIFIED;
+		return;
+	}
+
+	switch (priv->queue_format_pref) {
+	case GVE_DQO_RDA_FORMAT:
+		offered = *dev_op_dqo_rda;
+		break;
+	case GVE_DQO_QPL_FORMAT:
+		offered = *dev_op_dqo_qpl;
+		if (offered)
+			*dev_op_dqo_rda = NULL;
+		break;
+	case GVE_GQI_RDA_FORMAT:
+		/* Legacy devices advertise RDA via GQI_RAW_ADDRESSING */
+		offered = *dev_op_gqi_rda ||
+			  priv->queue_format == GVE_GQI_RDA_FORMAT;
+		if (offered) {
+			*dev_op_dqo_rda = NULL;
+			*dev_op_dqo_qpl = NULL;
+		}
+		break;
+	case GVE_GQI_QPL_FORMAT:
+		/* GQI QPL is always available as the fallback format */
+		offered = true;
+		*dev_op_dqo_rda = NULL;
+		*dev_op_dqo_qpl = NULL;
+		*dev_op_gqi_rda = NULL;
+		priv->queue_format = GVE_QUEUE_FORMAT_UNSPECIFIED;
+		break;
+	default:
+		return;
+	}
+
+	if (!offered)
+		dev_warn(&priv->pdev->dev,
+			 "Queue format %d not offered by device, using default\n",
+			 priv->queue_format_pref);
+}
+
 int gve_adminq_describe_device(struct gve_priv *priv)
 {
 	struct gve_device_option_modify_ring *dev_op_modify_ring = NULL;
@@ -953,6 +1101,9 @@ int gve_adminq_describe_device(struct gve_priv *priv)
 	if (err)
 		goto free_device_descriptor;
 
+	gve_apply_queue_format_pref(priv, &dev_op_gqi_rda, &dev_op_dqo_rda,
+				    &dev_op_dqo_qpl);
+
 	/* If the GQI_RAW_ADDRESSING option is not enabled and the queue format
 	 * is not set to GqiRda, choose the queue format in a priority order:
 	 * DqoRda, DqoQpl, GqiRda, GqiQpl. Use GqiQpl as default.
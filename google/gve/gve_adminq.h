@@ -536,6 +536,22 @@ union gve_adminq_command {
 
 static_assert(sizeof(union gve_adminq_command) == 64);
 
+/* A runtime admin command executed off the caller's context by the
+ * adminq async executor. exec issues the command and returns its status;
+ * done is always called exactly once with that status (or -ENODEV if the
+ * admin queue went away first) and owns freeing the command.
+ */
+struct gve_adminq_async_cmd {
+	struct list_head list;
+	int (*exec)(struct gve_priv *priv, struct gve_adminq_async_cmd *cmd);
+	void (*done)(struct gve_priv *priv, struct gve_adminq_async_cmd *cmd,
+		     int err);
+};
+
+void gve_adminq_async_init(struct gve_priv *priv);
+void gve_adminq_async_submit(struct gve_priv *priv,
+			     struct gve_adminq_async_cmd *cmd);
+void gve_adminq_async_drain(struct gve_priv *priv);
 int gve_adminq_alloc(struct device *dev, struct gve_priv *priv);
 void gve_adminq_free(struct device *dev, struct gve_priv *priv);
 void gve_adminq_release(struct gve_priv *priv);
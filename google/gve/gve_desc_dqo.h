@@ -257,5 +257,6 @@ static_assert(sizeof(struct gve_rx_compl_desc_dqo) == 32);
  * HW requires this value to be at least 8.
  */
 #define GVE_RX_BUF_THRESH_DQO 32
+#define GVE_RX_BUF_THRESH_MIN_DQO 8
 
 #endif /* _GVE_DESC_DQO_H_ */
@@ -0,0 +1,739 @@
+// SPDX-License-Identifier: (GPL-2.0 OR MIT)
+/* Google virtual Ethernet (gve) driver
+ *
+ * Copyright (C) 2015-2021 Google, Inc.
+ */
+
+#include <net/devlink.h>
+#include "gve.h"
+#include "gve_adminq.h"
+#include "gve_dqo.h"
+
+/* Minimum time between two automatic recoveries triggered by the same
+ * reporter. Errors reported within this window are still recorded and
+ * dumped, but do not schedule another reset.
+ */
+#define GVE_HEALTH_GRACE_PERIOD_MS (1000 * 10)
+
+struct gve_devlink_priv {
+	struct gve_priv *priv;
+};
+
+static const struct devlink_ops gve_devlink_ops = {
+};
+
+enum gve_devlink_param_id {
+	GVE_DEVLINK_PARAM_ID_BASE = DEVLINK_PARAM_GENERIC_ID_MAX,
+	GVE_DEVLINK_PARAM_ID_NAPI_TX_WEIGHT,
+	GVE_DEVLINK_PARAM_ID_NAPI_RX_WEIGHT,
+	GVE_DEVLINK_PARAM_ID_POLLED_QUEUES,
+	GVE_DEVLINK_PARAM_ID_TX_WAKE_THRESH_GQI,
+	GVE_DEVLINK_PARAM_ID_TX_WAKE_THRESH_DQO,
+};
+
+static int gve_devlink_napi_weight_get(struct devlink *devlink, u32 id,
+				       struct devlink_param_gset_ctx *ctx)
+{
+	struct gve_devlink_priv *dl_priv = devlink_priv(devlink);
+	struct gve_priv *priv = dl_priv->priv;
+
+	if (id == GVE_DEVLINK_PARAM_ID_NAPI_TX_WEIGHT)
+		ctx->val.vu32 = READ_ONCE(priv->napi_tx_weight_dqo);
+	else
+		ctx->val.vu32 = READ_ONCE(priv->napi_rx_weight_dqo);
+	return 0;
+}
+
+static int gve_devlink_napi_weight_set(struct devlink *devlink, u32 id,
+				       struct devlink_param_gset_ctx *ctx)
+{
+	struct gve_devlink_priv *dl_priv = devlink_priv(devlink);
+	struct gve_priv *priv = dl_priv->priv;
+
+	/* Picked up by the next NAPI poll */
+	if (id == GVE_DEVLINK_PARAM_ID_NAPI_TX_WEIGHT)
+		WRITE_ONCE(priv->napi_tx_weight_dqo, ctx->val.vu32);
+	else
+		WRITE_ONCE(priv->napi_rx_weight_dqo, ctx->val.vu32);
+	return 0;
+}
+
+static int gve_devlink_napi_weight_validate(struct devlink *devlink, u32 id,
+					    union devlink_param_value val,
+					    struct netlink_ext_ack *extack)
+{
+	if (!val.vu32 || val.vu32 > NAPI_POLL_WEIGHT) {
+		NL_SET_ERR_MSG_MOD(extack, "NAPI weight must be between 1 and 64");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int gve_devlink_tx_wake_thresh_get(struct devlink *devlink, u32 id,
+					  struct devlink_param_gset_ctx *ctx)
+{
+	struct gve_devlink_priv *dl_priv = devlink_priv(devlink);
+	struct gve_priv *priv = dl_priv->priv;
+
+	if (id == GVE_DEVLINK_PARAM_ID_TX_WAKE_THRESH_GQI)
+		ctx->val.vu32 = READ_ONCE(priv->tx_wake_thresh_gqi);
+	else
+		ctx->val.vu32 = READ_ONCE(priv->tx_wake_thresh_dqo);
+	return 0;
+}
+
+static int gve_devlink_tx_wake_thresh_set(struct devlink *devlink, u32 id,
+					  struct devlink_param_gset_ctx *ctx)
+{
+	struct gve_devlink_priv *dl_priv = devlink_priv(devlink);
+	struct gve_priv *priv = dl_priv->priv;
+
+	/* Picked up by the next TX completion */
+	if (id == GVE_DEVLINK_PARAM_ID_TX_WAKE_THRESH_GQI)
+		WRITE_ONCE(priv->tx_wake_thresh_gqi, ctx->val.vu32);
+	else
+		WRITE_ONCE(priv->tx_wake_thresh_dqo, ctx->val.vu32);
+	return 0;
+}
+
+static int gve_devlink_tx_wake_thresh_validate(struct devlink *devlink, u32 id,
+					       union devlink_param_value val,
+					       struct netlink_ext_ack *extack)
+{
+	/* A fully drained ring must always pass the threshold */
+	if (val.vu32 > GVE_TX_WAKE_THRESH_MAX) {
+		NL_SET_ERR_MSG_MOD(extack,
+				   "TX wake threshold must be between 0 and 90 percent");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int gve_devlink_polled_queues_get(struct devlink *devlink, u32 id,
+					 struct devlink_param_gset_ctx *ctx)
+{
+	struct gve_devlink_priv *dl_priv = devlink_priv(devlink);
+	struct gve_priv *priv = dl_priv->priv;
+
+	scnprintf(ctx->val.vstr, sizeof(ctx->val.vstr), "%*pbl",
+		  priv->polled_queues_nbits, priv->polled_queues);
+	return 0;
+}
+
+static int gve_devlink_polled_queues_set(struct devlink *devlink, u32 id,
+					 struct devlink_param_gset_ctx *ctx)
+{
+	struct gve_devlink_priv *dl_priv = devlink_priv(devlink);
+	struct gve_priv *priv = dl_priv->priv;
+	int err;
+
+	rtnl_lock();
+	err = bitmap_parselist(ctx->val.vstr, priv->polled_queues,
+			       priv->polled_queues_nbits);
+	if (!err)
+		gve_polled_update(priv);
+	rtnl_unlock();
+	return err;
+}
+
+static int gve_devlink_polled_queues_validate(struct devlink *devlink, u32 id,
+					      union devlink_param_value val,
+					      struct netlink_ext_ack *extack)
+{
+	struct gve_devlink_priv *dl_priv = devlink_priv(devlink);
+	struct gve_priv *priv = dl_priv->priv;
+	unsigned long *queues;
+	int err;
+
+	queues = bitmap_zalloc(priv->polled_queues_nbits, GFP_KERNEL);
+	if (!queues)
+		return -ENOMEM;
+
+	err = bitmap_parselist(val.vstr, queues, priv->polled_queues_nbits);
+	bitmap_free(queues);
+	if (err)
+		NL_SET_ERR_MSG_MOD(extack,
+				   "Expected a list of queue ids, e.g. \"0-3,8\"");
+	return err;
+}
+
+static const struct devlink_param gve_devlink_params[] = {
+	DEVLINK_PARAM_DRIVER(GVE_DEVLINK_PARAM_ID_POLLED_QUEUES,
+			     "polled_queues", DEVLINK_PARAM_TYPE_STRING,
+			     BIT(DEVLINK_PARAM_CMODE_RUNTIME),
+			     gve_devlink_polled_queues_get,
+			     gve_devlink_polled_queues_set,
+			     gve_devlink_polled_queues_validate),
+	DEVLINK_PARAM_DRIVER(GVE_DEVLINK_PARAM_ID_TX_WAKE_THRESH_GQI,
+			     "tx_wake_thresh_gqi", DEVLINK_PARAM_TYPE_U32,
+			     BIT(DEVLINK_PARAM_CMODE_RUNTIME),
+			     gve_devlink_tx_wake_thresh_get,
+			     gve_devlink_tx_wake_thresh_set,
+			     gve_devlink_tx_wake_thresh_validate),
+	DEVLINK_PARAM_DRIVER(GVE_DEVLINK_PARAM_ID_TX_WAKE_THRESH_DQO,
+			     "tx_wake_thresh_dqo", DEVLINK_PARAM_TYPE_U32,
+			     BIT(DEVLINK_PARAM_CMODE_RUNTIME),
+			     gve_devlink_tx_wake_thresh_get,
+			     gve_devlink_tx_wake_thresh_set,
+			     gve_devlink_tx_wake_thresh_validate),
+};
+
+/* Only registered for DQO queue formats, see gve_napi_poll_dqo() */
+static const struct devlink_param gve_devlink_dqo_params[] = {
+	DEVLINK_PARAM_DRIVER(GVE_DEVLINK_PARAM_ID_NAPI_TX_WEIGHT,
+			     "napi_tx_weight", DEVLINK_PARAM_TYPE_U32,
+			     BIT(DEVLINK_PARAM_CMODE_RUNTIME),
+			     gve_devlink_napi_weight_get,
+			     gve_devlink_napi_weight_set,
+			     gve_devlink_napi_weight_validate),
+	DEVLINK_PARAM_DRIVER(GVE_DEVLINK_PARAM_ID_NAPI_RX_WEIGHT,
+			     "napi_rx_weight", DEVLINK_PARAM_TYPE_U32,
+			     BIT(DEVLINK_PARAM_CMODE_RUNTIME),
+			     gve_devlink_napi_weight_get,
+			     gve_devlink_napi_weight_set,
+			     gve_devlink_napi_weight_validate),
+};
+
+static int gve_health_list_len(struct gve_rx_buf_state_dqo *buf_states,
+			       s16 head, u16 max_len)
+{
+	int len = 0;
+
+	while (head != -1 && len < max_len) {
+		head = buf_states[head].next;
+		len++;
+	}
+	return len;
+}
+
+/* Dumps are built from a snapshot taken under rcu_read_lock(), since
+ * devlink_fmsg_*() allocate and may sleep. gve_free_rings() and
+ * gve_adminq_free() wait for the grace period after clearing
+ * device_rings_ok and admin_queue_ok.
+ */
+#define GVE_HEALTH_MAX_PAIRS 20
+
+enum gve_health_pair_type {
+	GVE_HEALTH_U32,
+	GVE_HEALTH_U8,
+	GVE_HEALTH_BOOL,
+};
+
+struct gve_health_pair {
+	const char *name;
+	u32 val;
+	u8 type; /* enum gve_health_pair_type */
+};
+
+struct gve_health_snap {
+	struct gve_health_pair pairs[GVE_HEALTH_MAX_PAIRS];
+	int cnt;
+};
+
+static void gve_health_dump_put(struct gve_health_snap *snap,
+				const char *name, u32 val, u8 type)
+{
+	if (snap->cnt < GVE_HEALTH_MAX_PAIRS)
+		snap->pairs[snap->cnt++] = (struct gve_health_pair) {
+			.name = name, .val = val, .type = type,
+		};
+}
+
+static void gve_health_dump_emit(struct devlink_fmsg *fmsg,
+				 const struct gve_health_snap *snap)
+{
+	int i;
+
+	devlink_fmsg_obj_nest_start(fmsg);
+	for (i = 0; i < snap->cnt; i++) {
+		const struct gve_health_pair *p = &snap->pairs[i];
+
+		switch (p->type) {
+		case GVE_HEALTH_U8:
+			devlink_fmsg_u8_pair_put(fmsg, p->name, p->val);
+			break;
+		case GVE_HEALTH_BOOL:
+			devlink_fmsg_bool_pair_put(fmsg, p->name, p->val);
+			break;
+		default:
+			devlink_fmsg_u32_pair_put(fmsg, p->name, p->val);
+			break;
+		}
+	}
+	devlink_fmsg_obj_nest_end(fmsg);
+}
+
+static void gve_health_dump_tx_gqi(struct gve_health_snap *snap,
+				   struct gve_priv *priv,
+				   struct gve_tx_ring *tx)
+{
+	gve_health_dump_put(snap, "req", tx->req, GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "done", tx->done, GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "nic_done",
+			    gve_tx_load_event_counter(priv, tx), GVE_HEALTH_U32);
+	if (!tx->raw_addressing)
+		gve_health_dump_put(snap, "fifo_available",
+				    atomic_read(&tx->tx_fifo.available),
+				    GVE_HEALTH_U32);
+}
+
+static void gve_health_dump_tx_dqo(struct gve_health_snap *snap,
+				   struct gve_tx_ring *tx)
+{
+	u32 pending_data = 0, pending_reinject = 0, timed_out = 0;
+	int i;
+
+	for (i = 0; i < tx->dqo.num_pending_packets; i++) {
+		switch (READ_ONCE(tx->dqo.pending_packets[i].state)) {
+		case GVE_PACKET_STATE_PENDING_DATA_COMPL:
+			pending_data++;
+			break;
+		case GVE_PACKET_STATE_PENDING_REINJECT_COMPL:
+			pending_reinject++;
+			break;
+		case GVE_PACKET_STATE_TIMED_OUT_COMPL:
+			timed_out++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	gve_health_dump_put(snap, "tail", READ_ONCE(tx->dqo_tx.tail),
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "head", READ_ONCE(tx->dqo_tx.head),
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "hw_tx_head",
+			    atomic_read(&tx->dqo_compl.hw_tx_head),
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "compl_head", READ_ONCE(tx->dqo_compl.head),
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "compl_gen_bit",
+			    READ_ONCE(tx->dqo_compl.cur_gen_bit), GVE_HEALTH_U8);
+	gve_health_dump_put(snap, "num_pending_packets",
+			    tx->dqo.num_pending_packets, GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "pending_data_compl", pending_data,
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "pending_reinject_compl", pending_reinject,
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "timed_out_compl", timed_out,
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "kicked", READ_ONCE(tx->dqo_compl.kicked),
+			    GVE_HEALTH_BOOL);
+	gve_health_dump_put(snap, "last_compl_msecs_ago",
+			    jiffies_to_msecs(jiffies -
+					     READ_ONCE(tx->dqo_compl.last_processed)),
+			    GVE_HEALTH_U32);
+}
+
+static void gve_health_dump_tx(struct gve_health_snap *snap,
+			       struct gve_priv *priv,
+			       struct gve_tx_ring *tx)
+{
+	gve_health_dump_put(snap, "qid", tx->q_num, GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "ntfy_id", tx->ntfy_id, GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "mask", tx->mask, GVE_HEALTH_U32);
+	if (gve_is_gqi(priv))
+		gve_health_dump_tx_gqi(snap, priv, tx);
+	else
+		gve_health_dump_tx_dqo(snap, tx);
+	if (tx->netdev_txq)
+		gve_health_dump_put(snap, "stopped",
+				    netif_tx_queue_stopped(tx->netdev_txq),
+				    GVE_HEALTH_BOOL);
+	gve_health_dump_put(snap, "stop_queue", tx->stop_queue,
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "wake_queue", tx->wake_queue,
+			    GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "queue_timeout", tx->queue_timeout,
+			    GVE_HEALTH_U32);
+}
+
+static void gve_health_dump_rx(struct gve_health_snap *snap,
+			       struct gve_priv *priv,
+			       struct gve_rx_ring *rx)
+{
+	gve_health_dump_put(snap, "qid", rx->q_num, GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "ntfy_id", rx->ntfy_id, GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "cnt", READ_ONCE(rx->cnt), GVE_HEALTH_U32);
+	gve_health_dump_put(snap, "fill_cnt", READ_ONCE(rx->fill_cnt),
+			    GVE_HEALTH_U32);
+	if (gve_is_gqi(priv)) {
+		gve_health_dump_put(snap, "mask", rx->mask, GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "seqno", READ_ONCE(rx->desc.seqno),
+				    GVE_HEALTH_U8);
+		gve_health_dump_put(snap, "frag_cnt",
+				    READ_ONCE(rx->ctx.frag_cnt), GVE_HEALTH_U8);
+	} else {
+		struct gve_rx_buf_state_dqo *bs = rx->dqo.buf_states;
+		u16 n = rx->dqo.num_buf_states;
+
+		gve_health_dump_put(snap, "bufq_head",
+				    READ_ONCE(rx->dqo.bufq.head), GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "bufq_tail",
+				    READ_ONCE(rx->dqo.bufq.tail), GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "complq_head",
+				    READ_ONCE(rx->dqo.complq.head),
+				    GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "complq_gen_bit",
+				    READ_ONCE(rx->dqo.complq.cur_gen_bit),
+				    GVE_HEALTH_U8);
+		gve_health_dump_put(snap, "complq_free_slots",
+				    READ_ONCE(rx->dqo.complq.num_free_slots),
+				    GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "num_buf_states", n, GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "free_buf_states",
+				    gve_health_list_len(bs, READ_ONCE(rx->dqo.free_buf_states), n),
+				    GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "recycled_buf_states",
+				    gve_health_list_len(bs, READ_ONCE(rx->dqo.recycled_buf_states.head), n),
+				    GVE_HEALTH_U32);
+		gve_health_dump_put(snap, "used_buf_states",
+				    gve_health_list_len(bs, READ_ONCE(rx->dqo.used_buf_states.head), n),
+				    GVE_HEALTH_U32);
+	}
+}
+
+static int gve_health_recover(struct devlink_health_reporter *reporter,
+			      void *priv_ctx, struct netlink_ext_ack *extack)
+{
+	struct gve_priv *priv = devlink_health_reporter_priv(reporter);
+
+	/* A reset that is already pending or running covers this error. */
+	if (gve_get_do_reset(priv) || gve_get_reset_in_progress(priv) ||
+	    gve_get_probe_in_progress(priv))
+		return 0;
+
+	gve_schedule_reset(priv);
+	return 0;
+}
+
+/* Emits the reported queue, if any, followed by all queues */
+static void gve_health_dump_queues(struct devlink_fmsg *fmsg,
+				   const char *name,
+				   const struct gve_health_snap *snaps,
+				   int num, int *qid)
+{
+	int i;
+
+	if (qid && *qid >= 0 && *qid < num) {
+		devlink_fmsg_pair_nest_start(fmsg, "reported");
+		gve_health_dump_emit(fmsg, &snaps[*qid]);
+		devlink_fmsg_pair_nest_end(fmsg);
+	}
+
+	devlink_fmsg_arr_pair_nest_start(fmsg, name);
+	for (i = 0; i < num; i++)
+		gve_health_dump_emit(fmsg, &snaps[i]);
+	devlink_fmsg_arr_pair_nest_end(fmsg);
+}
+
+/* Only the netdev tx queues are dumped, XDP rings come and go with the
+ * program without clearing device_rings_ok.
+ */
+static int gve_tx_health_dump(struct devlink_health_reporter *reporter,
+			      struct devlink_fmsg *fmsg, void *priv_ctx,
+			      struct netlink_ext_ack *extack)
+{
+	struct gve_priv *priv = devlink_health_reporter_priv(reporter);
+	struct gve_health_snap *snaps;
+	struct gve_tx_ring *tx;
+	int i, num = 0;
+
+	snaps = kvcalloc(priv->tx_cfg.max_queues, sizeof(*snaps), GFP_KERNEL);
+	if (!snaps)
+		return -ENOMEM;
+
+	rcu_read_lock();
+	tx = READ_ONCE(priv->tx);
+	if (gve_get_device_rings_ok(priv) && tx) {
+		num = min_t(int, priv->tx_cfg.num_queues,
+			    priv->tx_cfg.max_queues);
+		for (i = 0; i < num; i++)
+			gve_health_dump_tx(&snaps[i], priv, &tx[i]);
+	}
+	rcu_read_unlock();
+
+	gve_health_dump_queues(fmsg, "tx_queues", snaps, num, priv_ctx);
+	kvfree(snaps);
+	return 0;
+}
+
+static int gve_rx_health_dump(struct devlink_health_reporter *reporter,
+			      struct devlink_fmsg *fmsg, void *priv_ctx,
+			      struct netlink_ext_ack *extack)
+{
+	struct gve_priv *priv = devlink_health_reporter_priv(reporter);
+	struct gve_health_snap *snaps;
+	struct gve_rx_ring *rx;
+	int i, num = 0;
+
+	snaps = kvcalloc(priv->rx_cfg.max_queues, sizeof(*snaps), GFP_KERNEL);
+	if (!snaps)
+		return -ENOMEM;
+
+	rcu_read_lock();
+	rx = READ_ONCE(priv->rx);
+	if (gve_get_device_rings_ok(priv) && rx) {
+		num = min_t(int, priv->rx_cfg.num_queues,
+			    priv->rx_cfg.max_queues);
+		for (i = 0; i < num; i++)
+			gve_health_dump_rx(&snaps[i], priv, &rx[i]);
+	}
+	rcu_read_unlock();
+
+	gve_health_dump_queues(fmsg, "rx_queues", snaps, num, priv_ctx);
+	kvfree(snaps);
+	return 0;
+}
+
+static int gve_adminq_health_dump(struct devlink_health_reporter *reporter,
+				  struct devlink_fmsg *fmsg, void *priv_ctx,
+				  struct netlink_ext_ack *extack)
+{
+	struct gve_priv *priv = devlink_health_reporter_priv(reporter);
+	u32 prod_cnt, event_cnt = 0, cmd_fail, timeouts, num = 0, i;
+	u32 max_cmds = PAGE_SIZE / sizeof(union gve_adminq_command);
+	bool ok;
+	struct {
+		u32 opcode;
+		u32 status;
+	} *cmds;
+
+	cmds = kcalloc(max_cmds, sizeof(*cmds), GFP_KERNEL);
+	if (!cmds)
+		return -ENOMEM;
+
+	rcu_read_lock();
+	ok = gve_get_admin_queue_ok(priv);
+	prod_cnt = READ_ONCE(priv->adminq_prod_cnt);
+	cmd_fail = READ_ONCE(priv->adminq_cmd_fail);
+	timeouts = READ_ONCE(priv->adminq_timeouts);
+	if (ok) {
+		event_cnt = ioread32be(&priv->reg_bar0->adminq_event_counter);
+		/* Commands the device has not acknowledged yet */
+		for (i = event_cnt; i != prod_cnt && num < max_cmds; i++) {
+			union gve_adminq_command *cmd =
+				&priv->adminq[i & priv->adminq_mask];
+
+			cmds[num].opcode = be32_to_cpu(READ_ONCE(cmd->opcode));
+			cmds[num].status = be32_to_cpu(READ_ONCE(cmd->status));
+			num++;
+		}
+	}
+	rcu_read_unlock();
+
+	devlink_fmsg_bool_pair_put(fmsg, "admin_queue_ok", ok);
+	if (!ok)
+		goto out;
+
+	devlink_fmsg_u32_pair_put(fmsg, "prod_cnt", prod_cnt);
+	devlink_fmsg_u32_pair_put(fmsg, "event_counter", event_cnt);
+	devlink_fmsg_u32_pair_put(fmsg, "cmd_fail", cmd_fail);
+	devlink_fmsg_u32_pair_put(fmsg, "timeouts", timeouts);
+
+	devlink_fmsg_arr_pair_nest_start(fmsg, "outstanding");
+	for (i = 0; i < num; i++) {
+		devlink_fmsg_obj_nest_start(fmsg);
+		devlink_fmsg_u32_pair_put(fmsg, "opcode", cmds[i].opcode);
+		devlink_fmsg_u32_pair_put(fmsg, "status", cmds[i].status);
+		devlink_fmsg_obj_nest_end(fmsg);
+	}
+	devlink_fmsg_arr_pair_nest_end(fmsg);
+out:
+	kfree(cmds);
+	return 0;
+}
+
+static const struct devlink_health_reporter_ops gve_tx_health_ops = {
+	.name = "tx_timeout",
+	.recover = gve_health_recover,
+	.dump = gve_tx_health_dump,
+};
+
+static const struct devlink_health_reporter_ops gve_rx_health_ops = {
+	.name = "rx_error",
+	.recover = gve_health_recover,
+	.dump = gve_rx_health_dump,
+};
+
+static const struct devlink_health_reporter_ops gve_adminq_health_ops = {
+	.name = "adminq_timeout",
+	.recover = gve_health_recover,
+	.dump = gve_adminq_health_dump,
+};
+
+/* devlink_health_report() sleeps, so errors detected in the datapath, timers
+ * or under spinlocks are handed off to gve_wq. Being on the ordered workqueue
+ * also serializes reports with the reset performed by the service task.
+ */
+static void gve_health_report_task(struct work_struct *work)
+{
+	struct gve_health_reporter *hr =
+		container_of(work, struct gve_health_reporter, report_task);
+	int qid = READ_ONCE(hr->qid);
+	int err;
+
+	/* Within the grace period, or while a failed recovery leaves the
+	 * reporter in error, devlink skips recovery; reset regardless.
+	 */
+	err = devlink_health_report(hr->reporter, hr->msg, &qid);
+	if (err && READ_ONCE(hr->reset))
+		gve_schedule_reset(hr->priv);
+}
+
+static void gve_health_report(struct gve_priv *priv,
+			      struct gve_health_reporter *hr,
+			      const char *msg, int qid, bool reset)
+{
+	if (!hr->reporter) {
+		if (reset)
+			gve_schedule_reset(priv);
+		return;
+	}
+
+	WRITE_ONCE(hr->qid, qid);
+	WRITE_ONCE(hr->reset, reset);
+	hr->msg = msg;
+	queue_work(priv->gve_wq, &hr->report_task);
+}
+
+void gve_health_report_tx_timeout(struct gve_priv *priv, int qid)
+{
+	gve_health_report(priv, &priv->tx_health, "TX timeout", qid, true);
+}
+
+void gve_health_report_rx_err(struct gve_priv *priv, int qid,
+			      const char *msg)
+{
+	gve_health_report(priv, &priv->rx_health, msg, qid, true);
+}
+
+void gve_health_report_adminq_timeout(struct gve_priv *priv)
+{
+	gve_health_report(priv, &priv->adminq_health,
+			  "Admin queue timeout", -1, false);
+}
+
+static int gve_health_reporter_create(struct gve_priv *priv,
+				      struct gve_health_reporter *hr,
+				      const struct devlink_health_reporter_ops *ops)
+{
+	struct devlink_health_reporter *reporter;
+
+	reporter = devlink_health_reporter_create(priv->devlink, ops,
+						  GVE_HEALTH_GRACE_PERIOD_MS,
+						  priv);
+	if (IS_ERR(reporter)) {
+		dev_warn(&priv->pdev->dev,
+			 "Failed to create %s health reporter: err=%ld\n",
+			 ops->name, PTR_ERR(reporter));
+		return PTR_ERR(reporter);
+	}
+
+	hr->priv = priv;
+	hr->qid = -1;
+	INIT_WORK(&hr->report_task, gve_health_report_task);
+	hr->reporter = reporter;
+	return 0;
+}
+
+static void gve_health_reporter_destroy(struct gve_health_reporter *hr)
+{
+	if (!hr->reporter)
+		return;
+
+	cancel_work_sync(&hr->report_task);
+	devlink_health_reporter_destroy(hr->reporter);
+	hr->reporter = NULL;
+}
+
+static void gve_health_reporters_destroy(struct gve_priv *priv)
+{
+	gve_health_reporter_destroy(&priv->adminq_health);
+	gve_health_reporter_destroy(&priv->rx_health);
+	gve_health_reporter_destroy(&priv->tx_health);
+}
+
+int gve_devlink_register(struct gve_priv *priv)
+{
+	struct gve_devlink_priv *dl_priv;
+	struct devlink *devlink;
+	int err;
+
+	devlink = devlink_alloc(&gve_devlink_ops, sizeof(*dl_priv),
+				&priv->pdev->dev);
+	if (!devlink)
+		return -ENOMEM;
+
+	dl_priv = devlink_priv(devlink);
+	dl_priv->priv = priv;
+	priv->devlink = devlink;
+
+	err = gve_health_reporter_create(priv, &priv->tx_health,
+					 &gve_tx_health_ops);
+	if (err)
+		goto abort_with_reporters;
+	err = gve_health_reporter_create(priv, &priv->rx_health,
+					 &gve_rx_health_ops);
+	if (err)
+		goto abort_with_reporters;
+	err = gve_health_reporter_create(priv, &priv->adminq_health,
+					 &gve_adminq_health_ops);
+	if (err)
+		goto abort_with_reporters;
+
+	priv->polled_queues_nbits = max(priv->tx_cfg.max_queues,
+					priv->rx_cfg.max_queues);
+	priv->polled_queues = bitmap_zalloc(priv->polled_queues_nbits,
+					    GFP_KERNEL);
+	if (!priv->polled_queues) {
+		err = -ENOMEM;
+		goto abort_with_reporters;
+	}
+
+	err = devlink_params_register(devlink, gve_devlink_params,
+				      ARRAY_SIZE(gve_devlink_params));
+	if (err)
+		goto abort_with_polled_queues;
+
+	if (!gve_is_gqi(priv)) {
+		err = devlink_params_register(devlink, gve_devlink_dqo_params,
+					      ARRAY_SIZE(gve_devlink_dqo_params));
+		if (err)
+			goto abort_with_params;
+	}
+
+	devlink_register(devlink);
+	return 0;
+
+abort_with_params:
+	devlink_params_unregister(devlink, gve_devlink_params,
+				  ARRAY_SIZE(gve_devlink_params));
+abort_with_polled_queues:
+	bitmap_free(priv->polled_queues);
+	priv->polled_queues = NULL;
+abort_with_reporters:
+	gve_health_reporters_destroy(priv);
+	devlink_free(devlink);
+	priv->devlink = NULL;
+	return err;
+}
+
+void gve_devlink_unregister(struct gve_priv *priv)
+{
+	if (!priv->devlink)
+		return;
+
+	devlink_unregister(priv->devlink);
+	if (!gve_is_gqi(priv))
+		devlink_params_unregister(priv->devlink, gve_devlink_dqo_params,
+					  ARRAY_SIZE(gve_devlink_dqo_params));
+	devlink_params_unregister(priv->devlink, gve_devlink_params,
+				  ARRAY_SIZE(gve_devlink_params));
+	gve_health_reporters_destroy(priv);
+	bitmap_free(priv->polled_queues);
+	priv->polled_queues = NULL;
+	devlink_free(priv->devlink);
+	priv->devlink = NULL;
+}
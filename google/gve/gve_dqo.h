@@ -20,6 +20,27 @@
 #define GVE_RX_IRQ_RATELIMIT_US_DQO 20
 #define GVE_MAX_ITR_INTERVAL_DQO (GVE_ITR_INTERVAL_DQO_MASK * 2)
 
+/* The DQO NAPI poll alternates between cleaning TX completions and
+ * processing RX packets in rounds of at most this many units per ring, so
+ * that a burst on one side cannot hold up the other for a whole poll.
+ */
+#define GVE_NAPI_TX_WEIGHT_DQO 16
+#define GVE_NAPI_RX_WEIGHT_DQO 16
+
+/* Time after which the DQO NAPI poll yields even if budget remains */
+#define GVE_NAPI_POLL_TIME_LIMIT_NS_DQO (500 * NSEC_PER_USEC)
+
+/* The RX poll refills the buffer queue every this many completions instead
+ * of only once at the end, so a full-budget poll cannot drain it.
+ */
+#define GVE_RX_POST_INTERVAL_DQO 32
+
+/* Used buffers checked for reuse when no recycled buffers are left */
+#define GVE_RX_PRESTAGE_SCAN_DQO 32
+
+/* Interval over which the minimum buffer queue depth is reported */
+#define GVE_RX_BUFQ_DEPTH_INTERVAL HZ
+
 /* Timeout in seconds to wait for a reinjection completion after receiving
  * its corresponding miss completion.
  */
@@ -33,8 +54,10 @@
 #define GVE_DEALLOCATE_COMPL_TIMEOUT 60
 
 netdev_tx_t gve_tx_dqo(struct sk_buff *skb, struct net_device *dev);
-bool gve_tx_poll_dqo(struct gve_notify_block *block, bool do_clean);
-int gve_rx_poll_dqo(struct gve_notify_block *block, int budget);
+bool gve_tx_poll_dqo(struct gve_notify_block *block, struct gve_tx_ring *tx,
+		     int budget);
+int gve_rx_poll_dqo(struct gve_notify_block *block, struct gve_rx_ring *rx,
+		    int budget);
 bool gve_tx_work_pending_dqo(struct gve_tx_ring *tx);
 int gve_tx_alloc_rings_dqo(struct gve_priv *priv);
 void gve_tx_free_rings_dqo(struct gve_priv *priv);
@@ -42,10 +65,14 @@ int gve_rx_alloc_rings_dqo(struct gve_priv *priv);
 void gve_rx_free_rings_dqo(struct gve_priv *priv);
 void gve_rx_reset_rings_dqo(struct gve_priv *priv);
 int gve_clean_tx_done_dqo(struct gve_priv *priv, struct gve_tx_ring *tx,
-			  struct napi_struct *napi);
+			  struct napi_struct *napi, int budget);
 void gve_rx_post_buffers_dqo(struct gve_rx_ring *rx);
 void gve_rx_write_doorbell_dqo(const struct gve_priv *priv, int queue_idx);
 int gve_rx_handle_hdr_resources_dqo(struct gve_priv *priv, bool enable_hdr_split);
+void gve_tx_get_mem_usage_dqo(struct gve_tx_ring *tx,
+			      struct gve_mem_usage *usage);
+void gve_rx_get_mem_usage_dqo(struct gve_rx_ring *rx,
+			      struct gve_mem_usage *usage);
 
 static inline void
 gve_tx_put_doorbell_dqo(const struct gve_priv *priv,
@@ -46,6 +46,10 @@ static const char gve_gstrings_main_stats[][ETH_GSTRING_LEN] = {
 	"rx_hsplit_err_dropped_pkt",
 	"interface_up_cnt", "interface_down_cnt", "reset_cnt",
 	"page_alloc_fail", "dma_mapping_error", "stats_report_trigger_cnt",
+	"rx_node_pool_pages", "rx_node_pool_borrow", "rx_node_pool_donate",
+	"mem_desc_bytes", "mem_data_bytes", "mem_copy_pool_bytes",
+	"mem_bookkeeping_bytes", "mem_pinned_bytes", "mem_total_bytes",
+	"mem_total_hwm_bytes",
 };
 
 static const char gve_gstrings_rx_stats[][ETH_GSTRING_LEN] = {
@@ -54,18 +58,28 @@ static const char gve_gstrings_rx_stats[][ETH_GSTRING_LEN] = {
 	"rx_cont_packet_cnt[%u]", "rx_frag_flip_cnt[%u]", "rx_frag_copy_cnt[%u]",
 	"rx_frag_alloc_cnt[%u]",
 	"rx_dropped_pkt[%u]", "rx_copybreak_pkt[%u]", "rx_copied_pkt[%u]",
+	"rx_udp_gro_pkt[%u]", "rx_gro_pkt[%u]", "rx_gro_merged_pkt[%u]",
+	"rx_gro_avg_segs_x100[%u]", "rx_bufq_min_depth[%u]",
 	"rx_queue_drop_cnt[%u]", "rx_no_buffers_posted[%u]",
 	"rx_drops_packet_over_mru[%u]", "rx_drops_invalid_checksum[%u]",
 	"rx_xdp_aborted[%u]", "rx_xdp_drop[%u]", "rx_xdp_pass[%u]",
 	"rx_xdp_tx[%u]", "rx_xdp_redirect[%u]",
 	"rx_xdp_tx_errors[%u]", "rx_xdp_redirect_errors[%u]", "rx_xdp_alloc_fails[%u]",
+	"rx_mem_desc_bytes[%u]", "rx_mem_data_bytes[%u]",
+	"rx_mem_copy_pool_bytes[%u]", "rx_mem_bookkeeping_bytes[%u]",
+	"rx_mem_pinned_bytes[%u]", "rx_mem_hwm_bytes[%u]",
 };
 
 static const char gve_gstrings_tx_stats[][ETH_GSTRING_LEN] = {
 	"tx_posted_desc[%u]", "tx_completed_desc[%u]", "tx_consumed_desc[%u]", "tx_bytes[%u]",
 	"tx_wake[%u]", "tx_stop[%u]", "tx_event_counter[%u]",
-	"tx_dma_mapping_error[%u]", "tx_xsk_wakeup[%u]",
-	"tx_xsk_done[%u]", "tx_xsk_sent[%u]", "tx_xdp_xmit[%u]", "tx_xdp_xmit_errors[%u]"
+	"tx_dma_mapping_error[%u]", "tx_compl_deferred[%u]",
+	"tx_stopped_lt_10us[%u]", "tx_stopped_lt_100us[%u]",
+	"tx_stopped_lt_1ms[%u]", "tx_stopped_lt_10ms[%u]",
+	"tx_stopped_ge_10ms[%u]", "tx_xsk_wakeup[%u]",
+	"tx_xsk_done[%u]", "tx_xsk_sent[%u]", "tx_xdp_xmit[%u]", "tx_xdp_xmit_errors[%u]",
+	"tx_mem_desc_bytes[%u]", "tx_mem_data_bytes[%u]",
+	"tx_mem_bookkeeping_bytes[%u]", "tx_mem_hwm_bytes[%u]",
 };
 
 static const char gve_gstrings_adminq_stats[][ETH_GSTRING_LEN] = {
@@ -76,18 +90,27 @@ static const char gve_gstrings_adminq_stats[][ETH_GSTRING_LEN] = {
 	"adminq_destroy_tx_queue_cnt", "adminq_destroy_rx_queue_cnt",
 	"adminq_dcfg_device_resources_cnt", "adminq_set_driver_parameter_cnt",
 	"adminq_report_stats_cnt", "adminq_report_link_speed_cnt",
-	"adminq_cfg_flow_rule", "adminq_cfg_rss_cnt"
+	"adminq_cfg_flow_rule", "adminq_cfg_rss_cnt",
+	"adminq_async_cmd_cnt", "adminq_async_cmd_fail"
+};
+
+static const char gve_gstrings_ntfy_blk_stats[][ETH_GSTRING_LEN] = {
+	"blk_tx_budget_exhausted[%u]", "blk_rx_budget_exhausted[%u]",
+	"blk_time_budget_exhausted[%u]", "blk_poll_busy_ns[%u]",
+	"blk_poll_run_ns[%u]",
 };
 
 static const char gve_gstrings_priv_flags[][ETH_GSTRING_LEN] = {
 	"report-stats", "enable-header-split", "enable-strict-header-split",
-	"enable-max-rx-buffer-size"
+	"enable-max-rx-buffer-size", "rx-tstamp-per-packet", "udp-gro",
+	"hsplit-page-aligned", "rx-flow-sort", "xdp-tx-colocate"
 };
 
 #define GVE_MAIN_STATS_LEN  ARRAY_SIZE(gve_gstrings_main_stats)
 #define GVE_ADMINQ_STATS_LEN  ARRAY_SIZE(gve_gstrings_adminq_stats)
 #define NUM_GVE_TX_CNTS	ARRAY_SIZE(gve_gstrings_tx_stats)
 #define NUM_GVE_RX_CNTS	ARRAY_SIZE(gve_gstrings_rx_stats)
+#define NUM_GVE_NTFY_BLK_CNTS	ARRAY_SIZE(gve_gstrings_ntfy_blk_stats)
 #define GVE_PRIV_FLAGS_STR_LEN ARRAY_SIZE(gve_gstrings_priv_flags)
 
 static void gve_get_strings(struct net_device *netdev, u32 stringset, u8 *data)
@@ -123,6 +146,14 @@ static void gve_get_strings(struct net_device *netdev, u32 stringset, u8 *data)
 		memcpy(s, *gve_gstrings_adminq_stats,
 		       sizeof(gve_gstrings_adminq_stats));
 		s += sizeof(gve_gstrings_adminq_stats);
+
+		for (i = 0; i < priv->num_ntfy_blks; i++) {
+			for (j = 0; j < NUM_GVE_NTFY_BLK_CNTS; j++) {
+				snprintf(s, ETH_GSTRING_LEN,
+					 gve_gstrings_ntfy_blk_stats[j], i);
+				s += ETH_GSTRING_LEN;
+			}
+		}
 		break;
 
 	case ETH_SS_PRIV_FLAGS:
@@ -146,7 +177,8 @@ static int gve_get_sset_count(struct net_device *netdev, int sset)
 	case ETH_SS_STATS:
 		return GVE_MAIN_STATS_LEN + GVE_ADMINQ_STATS_LEN +
 		       (priv->rx_cfg.num_queues * NUM_GVE_RX_CNTS) +
-		       (num_tx_queues * NUM_GVE_TX_CNTS);
+		       (num_tx_queues * NUM_GVE_TX_CNTS) +
+		       (priv->num_ntfy_blks * NUM_GVE_NTFY_BLK_CNTS);
 	case ETH_SS_PRIV_FLAGS:
 		return GVE_PRIV_FLAGS_STR_LEN;
 	default:
@@ -154,6 +186,102 @@ static int gve_get_sset_count(struct net_device *netdev, int sset)
 	}
 }
 
+/* Fills in the memory usage of a ring, adds it to the device-wide totals and
+ * returns the ring's total, which excludes pinned pages since those are
+ * already accounted for as data or copy pool pages.
+ */
+static u64 gve_get_ring_mem_usage(struct gve_priv *priv,
+				  struct gve_rx_ring *rx,
+				  struct gve_tx_ring *tx,
+				  struct gve_mem_usage *usage,
+				  struct gve_mem_usage *total)
+{
+	u64 ring_total = 0;
+	int c;
+
+	if (rx && gve_is_gqi(priv))
+		gve_rx_get_mem_usage(rx, usage);
+	else if (rx)
+		gve_rx_get_mem_usage_dqo(rx, usage);
+	else if (gve_is_gqi(priv))
+		gve_tx_get_mem_usage(tx, usage);
+	else
+		gve_tx_get_mem_usage_dqo(tx, usage);
+
+	for (c = 0; c < GVE_MEM_NUM_CATEGORIES; c++) {
+		total->bytes[c] += usage->bytes[c];
+		if (c != GVE_MEM_PINNED)
+			ring_total += usage->bytes[c];
+	}
+	return ring_total;
+}
+
+static void gve_get_node_pool_stats(struct gve_priv *priv, u64 *data)
+{
+	struct gve_rx_node_pool *pool;
+	int node;
+
+	data[0] = 0;
+	data[1] = 0;
+	data[2] = 0;
+	if (!priv->rx_node_pools)
+		return;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		pool = priv->rx_node_pools[node];
+		if (!pool)
+			continue;
+
+		spin_lock_bh(&pool->lock);
+		data[0] += pool->count;
+		data[1] += pool->borrow_cnt;
+		data[2] += pool->donate_cnt;
+		spin_unlock_bh(&pool->lock);
+	}
+}
+
+/* Record the memory in use right after the rings have been (re)built, with
+ * NAPI still off, and the baselines the DQO buffer-grow path adds its new
+ * pages to; see gve_rx_raise_mem_hwm_dqo().
+ */
+void gve_update_mem_hwm(struct gve_priv *priv)
+{
+	struct gve_mem_usage usage, total = {};
+	u64 ring_mem, total_mem, pool[3];
+	int ring;
+
+	if (priv->rx) {
+		for (ring = 0; ring < priv->rx_cfg.num_queues; ring++) {
+			struct gve_rx_ring *rx = &priv->rx[ring];
+
+			ring_mem = gve_get_ring_mem_usage(priv, rx, NULL,
+							  &usage, &total);
+			gve_mem_hwm_raise(&rx->mem_hwm, ring_mem);
+			rx->mem_fixed = ring_mem;
+			if (!gve_is_gqi(priv))
+				rx->mem_fixed -=
+					(u64)rx->dqo.num_buf_pages * PAGE_SIZE;
+		}
+	}
+	if (priv->tx) {
+		for (ring = 0; ring < gve_num_tx_queues(priv); ring++) {
+			struct gve_tx_ring *tx = &priv->tx[ring];
+
+			ring_mem = gve_get_ring_mem_usage(priv, NULL, tx,
+							  &usage, &total);
+			gve_mem_hwm_raise(&tx->mem_hwm, ring_mem);
+		}
+	}
+
+	gve_get_node_pool_stats(priv, pool);
+	total_mem = total.bytes[GVE_MEM_DESC] + total.bytes[GVE_MEM_DATA] +
+		    total.bytes[GVE_MEM_COPY_POOL] +
+		    total.bytes[GVE_MEM_BOOKKEEPING] + pool[0] * PAGE_SIZE;
+	gve_mem_hwm_raise(&priv->mem_hwm, total_mem);
+	priv->mem_fixed = total_mem -
+			  atomic64_read(&priv->rx_buf_pages) * PAGE_SIZE;
+}
+
 static void
 gve_get_ethtool_stats(struct net_device *netdev,
 		      struct ethtool_stats *stats, u64 *data)
@@ -166,7 +294,11 @@ gve_get_ethtool_stats(struct net_device *netdev,
 		rx_pkts, rx_pkts_sph, rx_pkts_hbo, rx_skb_alloc_fail, rx_bytes,
 		tx_pkts, tx_bytes, tx_dropped;
 	int stats_idx, base_stats_idx, max_stats_idx;
+	struct gve_mem_usage mem_usage, mem_total;
+	u64 ring_mem, total_mem;
 	struct stats *report_stats;
+	int mem_stats_idx;
+	u64 node_pool_pages;
 	int *rx_qid_to_stats_idx;
 	int *tx_qid_to_stats_idx;
 	struct gve_priv *priv;
@@ -262,6 +394,12 @@ gve_get_ethtool_stats(struct net_device *netdev,
 	data[i++] = priv->page_alloc_fail;
 	data[i++] = priv->dma_mapping_error;
 	data[i++] = priv->stats_report_trigger_cnt;
+	gve_get_node_pool_stats(priv, &data[i]);
+	node_pool_pages = data[i];
+	i += 3;
+	/* memory usage is filled in after walking the rings */
+	mem_stats_idx = i;
+	memset(&mem_total, 0, sizeof(mem_total));
 	i = GVE_MAIN_STATS_LEN;
 
 	/* For rx cross-reporting stats, start from nic rx stats in report */
@@ -314,6 +452,15 @@ gve_get_ethtool_stats(struct net_device *netdev,
 				tmp_rx_desc_err_dropped_pkt;
 			data[i++] = rx->rx_copybreak_pkt;
 			data[i++] = rx->rx_copied_pkt;
+			data[i++] = rx->rx_udp_gro_pkt;
+			data[i++] = rx->rx_gro_pkt;
+			data[i++] = rx->rx_gro_merged_pkt;
+			/* packets per skb that GRO passed up, scaled by 100 */
+			data[i++] = rx->rx_gro_pkt == rx->rx_gro_merged_pkt ? 0 :
+				div64_u64(rx->rx_gro_pkt * 100,
+					  rx->rx_gro_pkt - rx->rx_gro_merged_pkt);
+			data[i++] = gve_is_gqi(priv) ? 0 :
+				READ_ONCE(rx->dqo.bufq_min_depth_last);
 			/* stats from NIC */
 			if (skip_nic_stats) {
 				/* skip NIC rx stats */
@@ -338,6 +485,16 @@ gve_get_ethtool_stats(struct net_device *netdev,
 			} while (u64_stats_fetch_retry(&priv->rx[ring].statss,
 						       start));
 			i += GVE_XDP_ACTIONS + 3; /* XDP rx counters */
+			/* memory usage */
+			ring_mem = gve_get_ring_mem_usage(priv, rx, NULL,
+							  &mem_usage, &mem_total);
+			gve_mem_hwm_raise(&rx->mem_hwm, ring_mem);
+			data[i++] = mem_usage.bytes[GVE_MEM_DESC];
+			data[i++] = mem_usage.bytes[GVE_MEM_DATA];
+			data[i++] = mem_usage.bytes[GVE_MEM_COPY_POOL];
+			data[i++] = mem_usage.bytes[GVE_MEM_BOOKKEEPING];
+			data[i++] = mem_usage.bytes[GVE_MEM_PINNED];
+			data[i++] = atomic64_read(&rx->mem_hwm);
 		}
 	} else {
 		i += priv->rx_cfg.num_queues * NUM_GVE_RX_CNTS;
@@ -389,6 +546,9 @@ gve_get_ethtool_stats(struct net_device *netdev,
 			data[i++] = tx->stop_queue;
 			data[i++] = gve_tx_load_event_counter(priv, tx);
 			data[i++] = tx->dma_mapping_error;
+			data[i++] = tx->compl_deferred;
+			for (j = 0; j < GVE_TX_STOPPED_HIST_BUCKETS; j++)
+				data[i++] = tx->stopped_hist[j];
 			/* stats from NIC */
 			if (skip_nic_stats) {
 				/* skip NIC tx stats */
@@ -412,6 +572,14 @@ gve_get_ethtool_stats(struct net_device *netdev,
 			} while (u64_stats_fetch_retry(&priv->tx[ring].statss,
 						       start));
 			i += 3; /* XDP tx counters */
+			/* memory usage */
+			ring_mem = gve_get_ring_mem_usage(priv, NULL, tx,
+							  &mem_usage, &mem_total);
+			gve_mem_hwm_raise(&tx->mem_hwm, ring_mem);
+			data[i++] = mem_usage.bytes[GVE_MEM_DESC];
+			data[i++] = mem_usage.bytes[GVE_MEM_DATA];
+			data[i++] = mem_usage.bytes[GVE_MEM_BOOKKEEPING];
+			data[i++] = atomic64_read(&tx->mem_hwm);
 		}
 	} else {
 		i += num_tx_queues * NUM_GVE_TX_CNTS;
@@ -419,6 +587,21 @@ gve_get_ethtool_stats(struct net_device *netdev,
 
 	kfree(rx_qid_to_stats_idx);
 	kfree(tx_qid_to_stats_idx);
+
+	/* Device-wide memory usage, pages parked in node pools included */
+	mem_total.bytes[GVE_MEM_DATA] += node_pool_pages * PAGE_SIZE;
+	total_mem = mem_total.bytes[GVE_MEM_DESC] + mem_total.bytes[GVE_MEM_DATA] +
+		    mem_total.bytes[GVE_MEM_COPY_POOL] +
+		    mem_total.bytes[GVE_MEM_BOOKKEEPING];
+	gve_mem_hwm_raise(&priv->mem_hwm, total_mem);
+	data[mem_stats_idx++] = mem_total.bytes[GVE_MEM_DESC];
+	data[mem_stats_idx++] = mem_total.bytes[GVE_MEM_DATA];
+	data[mem_stats_idx++] = mem_total.bytes[GVE_MEM_COPY_POOL];
+	data[mem_stats_idx++] = mem_total.bytes[GVE_MEM_BOOKKEEPING];
+	data[mem_stats_idx++] = mem_total.bytes[GVE_MEM_PINNED];
+	data[mem_stats_idx++] = total_mem;
+	data[mem_stats_idx++] = atomic64_read(&priv->mem_hwm);
+
 	/* AQ Stats */
 	data[i++] = priv->adminq_prod_cnt;
 	data[i++] = priv->adminq_cmd_fail;
@@ -437,6 +620,23 @@ gve_get_ethtool_stats(struct net_device *netdev,
 	data[i++] = priv->adminq_report_link_speed_cnt;
 	data[i++] = priv->adminq_cfg_flow_rule_cnt;
 	data[i++] = priv->adminq_cfg_rss_cnt;
+	data[i++] = priv->adminq_async_cmd_cnt;
+	data[i++] = priv->adminq_async_cmd_fail;
+
+	/* Notify block stats */
+	for (ring = 0; ring < priv->num_ntfy_blks; ring++) {
+		if (priv->ntfy_blocks) {
+			struct gve_notify_block *block = &priv->ntfy_blocks[ring];
+
+			data[i++] = READ_ONCE(block->tx_budget_exhausted);
+			data[i++] = READ_ONCE(block->rx_budget_exhausted);
+			data[i++] = READ_ONCE(block->time_budget_exhausted);
+			data[i++] = READ_ONCE(block->poll_busy_ns);
+			data[i++] = READ_ONCE(block->poll_run_ns);
+		} else {
+			i += NUM_GVE_NTFY_BLK_CNTS;
+		}
+	}
 }
 
 static void gve_get_channels(struct net_device *netdev,
@@ -479,7 +679,15 @@ static int gve_set_channels(struct net_device *netdev,
 		return -EINVAL;
 	}
 
+	if (priv->num_xdp_queues && !gve_get_xdp_tx_colocate(priv) &&
+	    2 * new_tx > priv->num_ntfy_blks / 2) {
+		dev_err(&priv->pdev->dev, "XDP needs a dedicated notify block per TX queue, only %d available",
+			priv->num_ntfy_blks / 2);
+		return -EINVAL;
+	}
+
 	if (!netif_carrier_ok(netdev)) {
+		gve_qpl_prealloc_flush(priv);
 		priv->tx_cfg.num_queues = new_tx;
 		priv->rx_cfg.num_queues = new_rx;
 		return 0;
@@ -633,16 +841,21 @@ static int gve_set_priv_flags(struct net_device *netdev, u32 flags)
 	u64 ori_flags, new_flags, flag_diff;
 	int new_packet_buffer_size;
 	int num_tx_queues;
+	int err = 0;
 
 	/* If turning off header split, strict header split will be turned off too*/
 	if (gve_get_enable_header_split(priv) &&
 		!(flags & BIT(GVE_PRIV_FLAGS_ENABLE_HEADER_SPLIT))) {
 		flags &= ~BIT(GVE_PRIV_FLAGS_ENABLE_HEADER_SPLIT);
 		flags &= ~BIT(GVE_PRIV_FLAGS_ENABLE_STRICT_HEADER_SPLIT);
+		flags &= ~BIT(GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED);
 	}
 
-	/* If strict header-split is requested, turn on regular header-split */
-	if (flags & BIT(GVE_PRIV_FLAGS_ENABLE_STRICT_HEADER_SPLIT))
+	/* If strict or page-aligned header-split is requested, turn on regular
+	 * header-split
+	 */
+	if (flags & (BIT(GVE_PRIV_FLAGS_ENABLE_STRICT_HEADER_SPLIT) |
+		     BIT(GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED)))
 		flags |= BIT(GVE_PRIV_FLAGS_ENABLE_HEADER_SPLIT);
 
 	/* Make sure header-split is available */
@@ -660,6 +873,31 @@ static int gve_set_priv_flags(struct net_device *netdev, u32 flags)
 		return -EINVAL;
 	}
 
+	/* Payload buffers must span a whole page for the stack to map them
+	 * into userspace with TCP_ZEROCOPY_RECEIVE.
+	 */
+	if ((flags & BIT(GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED)) &&
+	    priv->dev_max_rx_buffer_size < PAGE_SIZE) {
+		dev_err(&priv->pdev->dev,
+			"Page-aligned header-split needs %lu byte rx buffers\n",
+			PAGE_SIZE);
+		return -EINVAL;
+	}
+
+	if ((flags & BIT(GVE_PRIV_FLAGS_UDP_GRO)) && gve_is_gqi(priv)) {
+		dev_err(&priv->pdev->dev,
+			"UDP GRO is only available with DQO queue formats\n");
+		return -EOPNOTSUPP;
+	}
+
+	if (priv->xdp_prog && !(flags & BIT(GVE_PRIV_FLAGS_XDP_TX_COLOCATE)) &&
+	    2 * priv->tx_cfg.num_queues > priv->num_ntfy_blks / 2) {
+		dev_err(&priv->pdev->dev,
+			"XDP needs a dedicated notify block per TX queue, only %d available\n",
+			priv->num_ntfy_blks / 2);
+		return -EINVAL;
+	}
+
 	num_tx_queues = gve_num_tx_queues(priv);
 	ori_flags = READ_ONCE(priv->ethtool_flags);
 
@@ -668,14 +906,19 @@ static int gve_set_priv_flags(struct net_device *netdev, u32 flags)
 	flag_diff = new_flags ^ ori_flags;
 
 	if ((flag_diff & BIT(GVE_PRIV_FLAGS_ENABLE_HEADER_SPLIT)) ||
-		(flag_diff & BIT(GVE_PRIV_FLAGS_ENABLE_MAX_RX_BUFFER_SIZE))) {
+		(flag_diff & BIT(GVE_PRIV_FLAGS_ENABLE_MAX_RX_BUFFER_SIZE)) ||
+		(flag_diff & BIT(GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED))) {
 		bool enable_hdr_split =
 			new_flags & BIT(GVE_PRIV_FLAGS_ENABLE_HEADER_SPLIT);
 		bool enable_max_buffer_size =
 			new_flags & BIT(GVE_PRIV_FLAGS_ENABLE_MAX_RX_BUFFER_SIZE);
-		int err;
+		bool page_aligned =
+			new_flags & BIT(GVE_PRIV_FLAGS_HSPLIT_PAGE_ALIGNED);
 
-		if (enable_max_buffer_size)
+		/* One buffer per page keeps every payload frag at offset 0 */
+		if (page_aligned)
+			new_packet_buffer_size = PAGE_SIZE;
+		else if (enable_max_buffer_size)
 			new_packet_buffer_size = priv->dev_max_rx_buffer_size;
 		else
 			new_packet_buffer_size = GVE_RX_BUFFER_SIZE_DQO;
@@ -689,6 +932,18 @@ static int gve_set_priv_flags(struct net_device *netdev, u32 flags)
 
 	priv->ethtool_flags = new_flags;
 
+	/* Running XDP tx rings pick up the new placement when re-created.
+	 * If that fails, report the placement back as unchanged but still
+	 * apply the remaining flags below.
+	 */
+	if ((flag_diff & BIT(GVE_PRIV_FLAGS_XDP_TX_COLOCATE)) &&
+	    priv->num_xdp_queues) {
+		err = gve_adjust_queues(priv, priv->rx_cfg, priv->tx_cfg);
+		if (err)
+			priv->ethtool_flags ^=
+				BIT(GVE_PRIV_FLAGS_XDP_TX_COLOCATE);
+	}
+
 	/* start report-stats timer when user turns report stats on. */
 	if (flags & BIT(0)) {
 		mod_timer(&priv->stats_report_timer,
@@ -711,7 +966,7 @@ static int gve_set_priv_flags(struct net_device *netdev, u32 flags)
 		(priv->ethtool_flags &
 		 BIT(GVE_PRIV_FLAGS_ENABLE_STRICT_HEADER_SPLIT)) ? true : false;
 
-	return 0;
+	return err;
 }
 
 static int gve_get_link_ksettings(struct net_device *netdev,
@@ -727,6 +982,23 @@ static int gve_get_link_ksettings(struct net_device *netdev,
 	return err;
 }
 
+static int gve_get_ts_info(struct net_device *netdev,
+			   struct ethtool_ts_info *info)
+{
+	/* RX "hardware" timestamps are host times taken at completion read,
+	 * see gve_hwtstamp_set().
+	 */
+	info->so_timestamping = SOF_TIMESTAMPING_TX_SOFTWARE |
+				SOF_TIMESTAMPING_RX_SOFTWARE |
+				SOF_TIMESTAMPING_SOFTWARE |
+				SOF_TIMESTAMPING_RX_HARDWARE |
+				SOF_TIMESTAMPING_RAW_HARDWARE;
+	info->phc_index = -1;
+	info->tx_types = BIT(HWTSTAMP_TX_OFF);
+	info->rx_filters = BIT(HWTSTAMP_FILTER_NONE) | BIT(HWTSTAMP_FILTER_ALL);
+	return 0;
+}
+
 static int gve_get_coalesce(struct net_device *netdev,
 			    struct ethtool_coalesce *ec,
 			    struct kernel_ethtool_coalesce *kernel_ec,
@@ -734,8 +1006,11 @@ static int gve_get_coalesce(struct net_device *netdev,
 {
 	struct gve_priv *priv = netdev_priv(netdev);
 
-	if (gve_is_gqi(priv))
-		return -EOPNOTSUPP;
+	/* GQI has no interrupt moderation, only tx completion batching */
+	if (gve_is_gqi(priv)) {
+		ec->tx_max_coalesced_frames = priv->tx_compl_thresh_gqi;
+		return 0;
+	}
 	ec->tx_coalesce_usecs = priv->tx_coalesce_usecs;
 	ec->rx_coalesce_usecs = priv->rx_coalesce_usecs;
 
@@ -752,7 +1027,17 @@ static int gve_set_coalesce(struct net_device *netdev,
 	u32 rx_usecs_orig = priv->rx_coalesce_usecs;
 	int idx;
 
-	if (gve_is_gqi(priv))
+	if (gve_is_gqi(priv)) {
+		if (ec->tx_coalesce_usecs || ec->rx_coalesce_usecs)
+			return -EOPNOTSUPP;
+		if (ec->tx_max_coalesced_frames > GVE_TX_COMPL_THRESH_MAX_GQI)
+			return -EINVAL;
+		WRITE_ONCE(priv->tx_compl_thresh_gqi,
+			   ec->tx_max_coalesced_frames);
+		return 0;
+	}
+
+	if (ec->tx_max_coalesced_frames)
 		return -EOPNOTSUPP;
 
 	if (ec->tx_coalesce_usecs > GVE_MAX_ITR_INTERVAL_DQO ||
@@ -762,7 +1047,9 @@ static int gve_set_coalesce(struct net_device *netdev,
 	priv->rx_coalesce_usecs = ec->rx_coalesce_usecs;
 
 	if (tx_usecs_orig != priv->tx_coalesce_usecs) {
-		for (idx = 0; idx < priv->tx_cfg.num_queues; idx++) {
+		for (idx = 0;
+		     idx < gve_num_tx_ntfy_blks(priv, priv->tx_cfg.num_queues);
+		     idx++) {
 			int ntfy_idx = gve_tx_idx_to_ntfy(priv, idx);
 			struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 
@@ -772,7 +1059,9 @@ static int gve_set_coalesce(struct net_device *netdev,
 	}
 
 	if (rx_usecs_orig != priv->rx_coalesce_usecs) {
-		for (idx = 0; idx < priv->rx_cfg.num_queues; idx++) {
+		for (idx = 0;
+		     idx < gve_num_rx_ntfy_blks(priv, priv->rx_cfg.num_queues);
+		     idx++) {
 			int ntfy_idx = gve_rx_idx_to_ntfy(priv, idx);
 			struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 
@@ -799,8 +1088,10 @@ static int gve_get_rxfh(struct net_device *netdev, u32 *indir, u8 *key,
 {
 	struct gve_priv *priv = netdev_priv(netdev);
 	struct gve_rss_config *rss_config = &priv->rss_config;
+	int err = 0;
 	u16 i;
 
+	mutex_lock(&priv->rss_config_lock);
 	if (hfunc) {
 		switch (rss_config->alg) {
 		case GVE_RSS_HASH_TOEPLITZ:
@@ -808,7 +1099,8 @@ static int gve_get_rxfh(struct net_device *netdev, u32 *indir, u8 *key,
 			break;
 		case GVE_RSS_HASH_UNDEFINED:
 		default:
-			return -EOPNOTSUPP;
+			err = -EOPNOTSUPP;
+			goto unlock;
 		}
 	}
 	if (key)
@@ -819,49 +1111,150 @@ static int gve_get_rxfh(struct net_device *netdev, u32 *indir, u8 *key,
 		for (i = 0; i < rss_config->indir_size; i++)
 			indir[i] = (u32)rss_config->indir[i];
 
-	return 0;
+unlock:
+	mutex_unlock(&priv->rss_config_lock);
+	return err;
 }
 
-static int gve_set_rxfh(struct net_device *netdev, const u32 *indir,
-			const u8 *key, const u8 hfunc)
+/* Only the fields ethtool asked to change travel with the command; they are
+ * merged onto the device's current config when the command runs, so that
+ * back-to-back updates build on each other in submission order.
+ */
+struct gve_rss_cmd {
+	struct gve_adminq_async_cmd async;
+	enum gve_rss_hash_alg alg; /* GVE_RSS_HASH_UNDEFINED: unchanged */
+	u8 *key; /* NULL: unchanged */
+	u32 *indir; /* NULL: unchanged */
+	struct gve_rss_config config; /* merged config sent to the device */
+};
+
+static void gve_rss_cmd_free(struct gve_rss_cmd *cmd)
 {
-	struct gve_priv *priv = netdev_priv(netdev);
-	struct gve_rss_config *rss_config = &priv->rss_config;
-	bool init = false;
-	u16 i;
+	gve_rss_config_release(&cmd->config);
+	kvfree(cmd->key);
+	kvfree(cmd->indir);
+	kfree(cmd);
+}
+
+static int gve_rss_cmd_exec(struct gve_priv *priv,
+			    struct gve_adminq_async_cmd *async)
+{
+	struct gve_rss_cmd *cmd = container_of(async, struct gve_rss_cmd, async);
+	struct gve_rss_config *config = &cmd->config;
 	int err = 0;
 
-	/* Initialize RSS if not configured before */
-	if (rss_config->alg == GVE_RSS_HASH_UNDEFINED) {
-		err = gve_rss_config_init(priv);
-		if (err)
-			return err;
-		init = true;
+	mutex_lock(&priv->rss_config_lock);
+	if (priv->rss_config.alg == GVE_RSS_HASH_UNDEFINED) {
+		/* Torn down since the command was queued. */
+		err = -ENODEV;
+		goto unlock;
 	}
+	*config = priv->rss_config;
+	config->key = kvzalloc(config->key_size, GFP_KERNEL);
+	config->indir = kvcalloc(config->indir_size, sizeof(*config->indir),
+				 GFP_KERNEL);
+	if (!config->key || !config->indir) {
+		err = -ENOMEM;
+		goto unlock;
+	}
+	memcpy(config->key, priv->rss_config.key, config->key_size);
+	memcpy(config->indir, priv->rss_config.indir,
+	       config->indir_size * sizeof(*config->indir));
+unlock:
+	mutex_unlock(&priv->rss_config_lock);
+	if (err)
+		return err;
+
+	if (cmd->alg != GVE_RSS_HASH_UNDEFINED)
+		config->alg = cmd->alg;
+	if (cmd->key)
+		memcpy(config->key, cmd->key, config->key_size);
+	if (cmd->indir)
+		memcpy(config->indir, cmd->indir,
+		       config->indir_size * sizeof(*config->indir));
+
+	return gve_adminq_configure_rss(priv, config);
+}
+
+static void gve_rss_cmd_done(struct gve_priv *priv,
+			     struct gve_adminq_async_cmd *async, int err)
+{
+	struct gve_rss_cmd *cmd = container_of(async, struct gve_rss_cmd, async);
+
+	/* priv->rss_config keeps mirroring the device if the update failed. */
+	if (err)
+		dev_err(&priv->pdev->dev,
+			"Failed to configure RSS: err=%d\n", err);
+	else
+		gve_rss_config_commit(priv, &cmd->config);
+	gve_rss_cmd_free(cmd);
+}
+
+static int gve_set_rxfh(struct net_device *netdev, const u32 *indir,
+			const u8 *key, const u8 hfunc)
+{
+	struct gve_priv *priv = netdev_priv(netdev);
+	enum gve_rss_hash_alg alg = GVE_RSS_HASH_UNDEFINED;
+	struct gve_rss_cmd *cmd;
+	bool configured;
+	int err;
 
 	switch (hfunc) {
 	case ETH_RSS_HASH_NO_CHANGE:
 		break;
 	case ETH_RSS_HASH_TOP:
-		rss_config->alg = GVE_RSS_HASH_TOEPLITZ;
+		alg = GVE_RSS_HASH_TOEPLITZ;
 		break;
 	default:
 		return -EOPNOTSUPP;
 	}
 
-	if (!key && !indir && !init)
+	mutex_lock(&priv->rss_config_lock);
+	configured = priv->rss_config.alg != GVE_RSS_HASH_UNDEFINED;
+	mutex_unlock(&priv->rss_config_lock);
+
+	/* Initialize RSS if not configured before */
+	if (!configured) {
+		err = gve_rss_config_init(priv);
+		if (err)
+			return err;
+	}
+
+	if (!key && !indir)
 		return 0;
 
-	if (key)
-		memcpy(rss_config->key, key, rss_config->key_size);
+	cmd = kzalloc(sizeof(*cmd), GFP_KERNEL);
+	if (!cmd)
+		return -ENOMEM;
 
+	cmd->alg = alg;
+	if (key) {
+		cmd->key = kvzalloc(GVE_RSS_KEY_SIZE, GFP_KERNEL);
+		if (!cmd->key)
+			goto err_free;
+		memcpy(cmd->key, key, GVE_RSS_KEY_SIZE);
+	}
 	if (indir) {
 		/* Each 32 bits pointed by 'indir' is stored with a lut entry */
-		for (i = 0; i < rss_config->indir_size; i++)
-			rss_config->indir[i] = indir[i];
+		cmd->indir = kvcalloc(GVE_RSS_INDIR_SIZE, sizeof(*cmd->indir),
+				      GFP_KERNEL);
+		if (!cmd->indir)
+			goto err_free;
+		memcpy(cmd->indir, indir,
+		       GVE_RSS_INDIR_SIZE * sizeof(*cmd->indir));
 	}
 
-	return gve_adminq_configure_rss(priv, rss_config);
+	/* Hand the update to the async executor so the caller does not wait
+	 * on the device under RTNL; priv->rss_config follows on success.
+	 */
+	cmd->async.exec = gve_rss_cmd_exec;
+	cmd->async.done = gve_rss_cmd_done;
+	gve_adminq_async_submit(priv, &cmd->async);
+	return 0;
+
+err_free:
+	gve_rss_cmd_free(cmd);
+	return -ENOMEM;
 }
 
 static const char *gve_flow_type_name(enum gve_adminq_flow_type flow_type)
@@ -993,6 +1386,76 @@ static void gve_flow_rules_del_rule(struct gve_priv *priv, struct gve_flow_rule
 	priv->flow_rules_cnt--;
 }
 
+struct gve_flow_rule_cmd {
+	struct gve_adminq_async_cmd async;
+	struct gve_flow_rule rule;
+	bool add;
+};
+
+static int gve_flow_rule_cmd_exec(struct gve_priv *priv,
+				  struct gve_adminq_async_cmd *async)
+{
+	struct gve_flow_rule_cmd *cmd =
+		container_of(async, struct gve_flow_rule_cmd, async);
+
+	if (cmd->add)
+		return gve_adminq_add_flow_rule(priv, &cmd->rule);
+	return gve_adminq_del_flow_rule(priv, cmd->rule.loc);
+}
+
+/* Rules are inserted into flow_rules when the add is queued and only
+ * removed once the device has acked the delete, so that the list never
+ * drops a rule the device still holds. If the device rejects an add, drop
+ * the rule again unless it was already deleted or replaced by a newer rule
+ * at the same location; if it rejects a delete, the rule stays.
+ */
+static void gve_flow_rule_cmd_done(struct gve_priv *priv,
+				   struct gve_adminq_async_cmd *async, int err)
+{
+	struct gve_flow_rule_cmd *cmd =
+		container_of(async, struct gve_flow_rule_cmd, async);
+	struct gve_flow_rule *rule;
+
+	if (err)
+		dev_err(&priv->pdev->dev, "Failed to %s flow rule %u: err=%d\n",
+			cmd->add ? "add" : "delete", cmd->rule.loc, err);
+	else if (cmd->add)
+		gve_print_flow_rule(priv, &cmd->rule);
+
+	if (cmd->add && !err)
+		goto out;
+
+	mutex_lock(&priv->flow_rules_lock);
+	rule = gve_find_flow_rule_by_loc(priv, cmd->rule.loc);
+	if (rule && rule->id == cmd->rule.id) {
+		if (cmd->add || !err)
+			gve_flow_rules_del_rule(priv, rule);
+		else
+			rule->del_pending = false;
+	}
+	mutex_unlock(&priv->flow_rules_lock);
+out:
+	kfree(cmd);
+}
+
+static int gve_flow_rule_submit(struct gve_priv *priv,
+				struct gve_flow_rule *rule, bool add)
+{
+	struct gve_flow_rule_cmd *cmd;
+
+	cmd = kzalloc(sizeof(*cmd), GFP_KERNEL);
+	if (!cmd)
+		return -ENOMEM;
+
+	cmd->rule = *rule;
+	INIT_LIST_HEAD(&cmd->rule.list);
+	cmd->add = add;
+	cmd->async.exec = gve_flow_rule_cmd_exec;
+	cmd->async.done = gve_flow_rule_cmd_done;
+	gve_adminq_async_submit(priv, &cmd->async);
+	return 0;
+}
+
 static int
 gve_get_flow_rule_entry(struct gve_priv *priv, struct ethtool_rxnfc *cmd)
 {
@@ -1003,7 +1466,7 @@ gve_get_flow_rule_entry(struct gve_priv *priv, struct ethtool_rxnfc *cmd)
 	if (priv->flow_rules_max == 0)
 		return -EOPNOTSUPP;
 
-	spin_lock_bh(&priv->flow_rules_lock);
+	mutex_lock(&priv->flow_rules_lock);
 	rule = gve_find_flow_rule_by_loc(priv, fsp->location);
 	if (!rule) {
 		err = -EINVAL;
@@ -1118,7 +1581,7 @@ gve_get_flow_rule_entry(struct gve_priv *priv, struct ethtool_rxnfc *cmd)
 	fsp->ring_cookie = rule->action;
 
 ret:
-	spin_unlock_bh(&priv->flow_rules_lock);
+	mutex_unlock(&priv->flow_rules_lock);
 	return err;
 }
 
@@ -1135,7 +1598,7 @@ gve_get_flow_rule_ids(struct gve_priv *priv, struct ethtool_rxnfc *cmd,
 
 	cmd->data = priv->flow_rules_max;
 
-	spin_lock_bh(&priv->flow_rules_lock);
+	mutex_lock(&priv->flow_rules_lock);
 	list_for_each_entry(rule, &priv->flow_rules, list) {
 		if (cnt == cmd->rule_cnt) {
 			err = -EMSGSIZE;
@@ -1147,7 +1610,7 @@ gve_get_flow_rule_ids(struct gve_priv *priv, struct ethtool_rxnfc *cmd,
 	cmd->rule_cnt = cnt;
 
 ret:
-	spin_unlock_bh(&priv->flow_rules_lock);
+	mutex_unlock(&priv->flow_rules_lock);
 	return err;
 }
 
@@ -1268,7 +1731,7 @@ gve_add_flow_rule_info(struct gve_priv *priv, struct ethtool_rx_flow_spec *fsp,
 static int gve_add_flow_rule(struct gve_priv *priv, struct ethtool_rxnfc *cmd)
 {
 	struct ethtool_rx_flow_spec *fsp = &cmd->fs;
-	struct gve_flow_rule *rule = NULL;
+	struct gve_flow_rule *rule = NULL, *old;
 	int err;
 
 	if (priv->flow_rules_max == 0)
@@ -1281,8 +1744,14 @@ static int gve_add_flow_rule(struct gve_priv *priv, struct ethtool_rxnfc *cmd)
 		return -ENOSPC;
 	}
 
-	spin_lock_bh(&priv->flow_rules_lock);
-	if (gve_find_flow_rule_by_loc(priv, fsp->location)) {
+	mutex_lock(&priv->flow_rules_lock);
+	old = gve_find_flow_rule_by_loc(priv, fsp->location);
+	if (old && old->del_pending) {
+		/* The location frees up once the device acks the delete. */
+		err = -EBUSY;
+		goto ret;
+	}
+	if (old) {
 		dev_err(&priv->pdev->dev, "Flow rule %d already exists\n",
 			fsp->location);
 		err = -EEXIST;
@@ -1299,17 +1768,17 @@ static int gve_add_flow_rule(struct gve_priv *priv, struct ethtool_rxnfc *cmd)
 	if (err)
 		goto ret;
 
-	err = gve_adminq_add_flow_rule(priv, rule);
+	rule->id = priv->flow_rules_next_id++;
+	err = gve_flow_rule_submit(priv, rule, true);
 	if (err)
 		goto ret;
 
 	gve_flow_rules_add_rule(priv, rule);
-	gve_print_flow_rule(priv, rule);
 
 ret:
-	spin_unlock_bh(&priv->flow_rules_lock);
+	mutex_unlock(&priv->flow_rules_lock);
 	if (err && rule)
-		kfree(rule);
+		kvfree(rule);
 	return err;
 }
 
@@ -1322,21 +1791,26 @@ static int gve_del_flow_rule(struct gve_priv *priv, struct ethtool_rxnfc *cmd)
 	if (priv->flow_rules_max == 0)
 		return -EOPNOTSUPP;
 
-	spin_lock_bh(&priv->flow_rules_lock);
+	mutex_lock(&priv->flow_rules_lock);
 	rule = gve_find_flow_rule_by_loc(priv, fsp->location);
 	if (!rule) {
 		err = -EINVAL;
 		goto ret;
 	}
+	if (rule->del_pending) {
+		err = -EBUSY;
+		goto ret;
+	}
 
-	err = gve_adminq_del_flow_rule(priv, fsp->location);
+	/* The rule leaves flow_rules in gve_flow_rule_cmd_done(). */
+	err = gve_flow_rule_submit(priv, rule, false);
 	if (err)
 		goto ret;
 
-	gve_flow_rules_del_rule(priv, rule);
+	rule->del_pending = true;
 
 ret:
-	spin_unlock_bh(&priv->flow_rules_lock);
+	mutex_unlock(&priv->flow_rules_lock);
 	return err;
 }
 
@@ -1400,7 +1874,8 @@ static int gve_get_rxnfc(struct net_device *netdev, struct ethtool_rxnfc *cmd,
 }
 
 const struct ethtool_ops gve_ethtool_ops = {
-	.supported_coalesce_params = ETHTOOL_COALESCE_USECS,
+	.supported_coalesce_params = ETHTOOL_COALESCE_USECS |
+				     ETHTOOL_COALESCE_TX_MAX_FRAMES,
 	.get_drvinfo = gve_get_drvinfo,
 	.get_strings = gve_get_strings,
 	.get_sset_count = gve_get_sset_count,
@@ -1425,5 +1900,6 @@ const struct ethtool_ops gve_ethtool_ops = {
 	.set_tunable = gve_set_tunable,
 	.get_priv_flags = gve_get_priv_flags,
 	.set_priv_flags = gve_set_priv_flags,
-	.get_link_ksettings = gve_get_link_ksettings
+	.get_link_ksettings = gve_get_link_ksettings,
+	.get_ts_info = gve_get_ts_info,
 };
@@ -5,13 +5,16 @@
  */
 
 #include <linux/bpf.h>
+#include <linux/cc_platform.h>
 #include <linux/cpumask.h>
 #include <linux/etherdevice.h>
 #include <linux/filter.h>
 #include <linux/interrupt.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 #include <linux/utsname.h>
@@ -22,6 +25,7 @@
 #include "gve_dqo.h"
 #include "gve_adminq.h"
 #include "gve_register.h"
+#include "gve_utils.h"
 
 #define GVE_DEFAULT_RX_COPYBREAK	(256)
 
@@ -35,6 +39,33 @@
 const char gve_version_str[] = GVE_VERSION;
 static const char gve_version_prefix[] = GVE_VERSION_PREFIX;
 
+static int queue_format;
+module_param(queue_format, int, 0444);
+MODULE_PARM_DESC(queue_format,
+		 "Preferred queue format if offered by the device (0=default, 1=GQI RDA, 2=GQI QPL, 3=DQO RDA, 4=DQO QPL)");
+
+static bool rx_node_pool;
+module_param(rx_node_pool, bool, 0444);
+MODULE_PARM_DESC(rx_node_pool,
+		 "Share spare RX pages between DQO RDA queues on the same NUMA node");
+
+static bool tx_sg_map;
+module_param(tx_sg_map, bool, 0444);
+MODULE_PARM_DESC(tx_sg_map,
+		 "Map each RDA TX packet as one scatterlist instead of per buffer");
+
+static int cvm_mode = -1;
+module_param(cvm_mode, int, 0444);
+MODULE_PARM_DESC(cvm_mode,
+		 "Confidential VM mode: prefer QPL formats backed by host-shared pages (-1=auto, 0=off, 1=on)");
+
+static bool gve_use_cvm_mode(void)
+{
+	if (cvm_mode >= 0)
+		return cvm_mode;
+	return cc_platform_has(CC_ATTR_GUEST_MEM_ENCRYPT);
+}
+
 static int gve_verify_driver_compatibility(struct gve_priv *priv)
 {
 	int err;
@@ -184,10 +215,13 @@ static int gve_alloc_stats_report(struct gve_priv *priv)
 {
 	int tx_stats_num, rx_stats_num;
 
+	/* Sized for the max queue counts, so ethtool -L can grow either
+	 * direction without reallocating the report.
+	 */
 	tx_stats_num = (GVE_TX_STATS_REPORT_NUM + NIC_TX_STATS_REPORT_NUM) *
-		       gve_num_tx_queues(priv);
+		       priv->tx_cfg.max_queues;
 	rx_stats_num = (GVE_RX_STATS_REPORT_NUM + NIC_RX_STATS_REPORT_NUM) *
-		       priv->rx_cfg.num_queues;
+		       priv->rx_cfg.max_queues;
 	priv->stats_report_len = struct_size(priv->stats_report, stats,
 					     tx_stats_num + rx_stats_num);
 	priv->stats_report =
@@ -227,9 +261,9 @@ static void gve_tx_timeout_for_miss_path(struct net_device *dev, unsigned int tx
 		return;
 
 	block = &priv->ntfy_blocks[ntfy_idx];
-	tx = block->tx;
-	if (!tx)
+	if (!block->tx)
 		return;
+	tx = &priv->tx[txqueue];
 
 	/* Check to see if there is pending work */
 	has_work = gve_tx_work_pending_dqo(tx);
@@ -240,7 +274,7 @@ static void gve_tx_timeout_for_miss_path(struct net_device *dev, unsigned int tx
 		netdev_warn(dev,
 			    "TX timeout on queue %d. Scheduling reset.",
 			    txqueue);
-		gve_schedule_reset(priv);
+		gve_health_report_tx_timeout(priv, txqueue);
 	}
 
 	gve_write_irq_doorbell_dqo(priv, block, GVE_ITR_NO_UPDATE_DQO);
@@ -309,34 +343,108 @@ static irqreturn_t gve_intr_dqo(int irq, void *arg)
 	return IRQ_HANDLED;
 }
 
+/* Returns the share of the remaining budget that the next of rings_left rings
+ * sharing a notify block may consume. Budget left unused by earlier rings
+ * carries over to later ones. A budget of 0 (netpoll) stays 0.
+ */
+static int gve_ntfy_ring_budget(int budget_left, int rings_left)
+{
+	return DIV_ROUND_UP(budget_left, rings_left);
+}
+
+/* Polls every rx ring on the block, splitting the budget between them.
+ * Returns the total work done and sets *reschedule if any ring used up its
+ * share. A budget smaller than the number of rings runs out before the last
+ * rings, so each call starts at the ring the previous one stopped at.
+ */
+static int gve_napi_poll_rx(struct gve_notify_block *block, int budget,
+			    bool *reschedule)
+{
+	struct gve_priv *priv = block->priv;
+	int rings_left = block->num_rx;
+	struct gve_rx_ring *rx = block->rx;
+	int work_done = 0;
+	int start, i;
+
+	if (!rx)
+		return 0;
+
+	start = block->rx_start % block->num_rx;
+	for (i = 0; i < start; i++)
+		rx = rx->ntfy_next;
+
+	for (; rings_left; rings_left--) {
+		int ring_budget, ring_done;
+
+		if (budget && work_done == budget) {
+			*reschedule = true;
+			break;
+		}
+
+		ring_budget = gve_ntfy_ring_budget(budget - work_done,
+						   rings_left);
+		if (gve_is_gqi(priv))
+			ring_done = gve_rx_poll(block, rx, ring_budget);
+		else
+			ring_done = gve_rx_poll_dqo(block, rx, ring_budget);
+		*reschedule |= ring_done == ring_budget;
+		work_done += ring_done;
+		rx = rx->ntfy_next ?: block->rx;
+	}
+
+	block->rx_start = (start + block->num_rx - rings_left) % block->num_rx;
+	return work_done;
+}
+
 static int gve_napi_poll(struct napi_struct *napi, int budget)
 {
 	struct gve_notify_block *block;
 	__be32 __iomem *irq_doorbell;
 	bool reschedule = false;
 	struct gve_priv *priv;
-	int work_done = 0;
+	struct gve_tx_ring *tx;
+	struct gve_rx_ring *rx;
+	int tx_done = 0;
+	int rings_left;
+	int work_done;
 
 	block = container_of(napi, struct gve_notify_block, napi);
 	priv = block->priv;
 
-	if (block->tx) {
-		if (block->tx->q_num < priv->tx_cfg.num_queues)
-			reschedule |= gve_tx_poll(block, budget);
+	/* Completions a tx ring leaves unused carry over to the next ring,
+	 * as on the rx side.
+	 */
+	rings_left = block->num_tx;
+	for (tx = block->tx; tx; tx = tx->ntfy_next, rings_left--) {
+		int ring_budget;
+		u32 done;
+
+		if (budget && tx_done >= budget) {
+			reschedule = true;
+			break;
+		}
+
+		ring_budget = gve_ntfy_ring_budget(budget - tx_done,
+						   rings_left);
+		done = READ_ONCE(tx->done);
+		if (tx->q_num < priv->tx_cfg.num_queues)
+			reschedule |= gve_tx_poll(block, tx, ring_budget);
 		else
-			reschedule |= gve_xdp_poll(block, budget);
+			reschedule |= gve_xdp_poll(block, tx, ring_budget);
+		tx_done += min_t(u32, READ_ONCE(tx->done) - done, ring_budget);
 	}
 
-	if (block->rx) {
-		work_done = gve_rx_poll(block, budget);
-		reschedule |= work_done == budget;
-	}
+	work_done = gve_napi_poll_rx(block, budget, &reschedule);
 
 	if (reschedule)
 		return budget;
 
        /* Complete processing - don't unmask irq if busy polling is enabled */
 	if (likely(napi_complete_done(napi, work_done))) {
+		/* Polled blocks keep the irq masked, see gve_poll_thread() */
+		if (READ_ONCE(block->polled))
+			return work_done;
+
 		irq_doorbell = gve_irq_doorbell(priv, block);
 		iowrite32be(GVE_IRQ_ACK | GVE_IRQ_EVENT, irq_doorbell);
 
@@ -345,10 +453,10 @@ static int gve_napi_poll(struct napi_struct *napi, int budget)
 		 */
 		mb();
 
-		if (block->tx)
-			reschedule |= gve_tx_clean_pending(priv, block->tx);
-		if (block->rx)
-			reschedule |= gve_rx_work_pending(block->rx);
+		for (tx = block->tx; tx; tx = tx->ntfy_next)
+			reschedule |= gve_tx_clean_pending(priv, tx);
+		for (rx = block->rx; rx; rx = rx->ntfy_next)
+			reschedule |= gve_rx_work_pending(rx);
 
 		if (reschedule && napi_reschedule(napi))
 			iowrite32be(GVE_IRQ_MASK, irq_doorbell);
@@ -356,26 +464,72 @@ static int gve_napi_poll(struct napi_struct *napi, int budget)
 	return work_done;
 }
 
+/* Alternates between TX completion cleaning and RX processing in rounds of
+ * napi_{tx,rx}_weight_dqo per ring until both are drained, or one of the
+ * bounds is hit: napi->weight completions per tx ring, the rx budget, or
+ * GVE_NAPI_POLL_TIME_LIMIT_NS_DQO. Hitting a bound with work left
+ * schedules another poll and is counted per block.
+ */
 static int gve_napi_poll_dqo(struct napi_struct *napi, int budget)
 {
 	struct gve_notify_block *block =
 		container_of(napi, struct gve_notify_block, napi);
+	int rx_weight, tx_weight, tx_left = napi->weight;
 	struct gve_priv *priv = block->priv;
+	bool rx_pending = block->rx && budget;
+	bool tx_pending = !!block->tx;
 	bool reschedule = false;
+	struct gve_tx_ring *tx;
 	int work_done = 0;
+	u64 deadline;
+
+	tx_weight = READ_ONCE(priv->napi_tx_weight_dqo);
+	rx_weight = READ_ONCE(priv->napi_rx_weight_dqo);
+	deadline = local_clock() + GVE_NAPI_POLL_TIME_LIMIT_NS_DQO;
+
+	while (tx_pending || rx_pending) {
+		if (tx_pending) {
+			int chunk = min(tx_weight, tx_left);
+
+			tx_pending = false;
+			for (tx = block->tx; tx; tx = tx->ntfy_next)
+				tx_pending |= gve_tx_poll_dqo(block, tx, chunk);
+			tx_left -= chunk;
+			if (tx_pending && !tx_left) {
+				block->tx_budget_exhausted++;
+				reschedule = true;
+				tx_pending = false;
+			}
+		}
+
+		if (rx_pending) {
+			int chunk = min(rx_weight, budget - work_done);
 
-	if (block->tx)
-		reschedule |= gve_tx_poll_dqo(block, /*do_clean=*/true);
+			rx_pending = false;
+			work_done += gve_napi_poll_rx(block, chunk, &rx_pending);
+			if (rx_pending && work_done == budget) {
+				block->rx_budget_exhausted++;
+				reschedule = true;
+				rx_pending = false;
+			}
+		}
 
-	if (block->rx) {
-		work_done = gve_rx_poll_dqo(block, budget);
-		reschedule |= work_done == budget;
+		if ((tx_pending || rx_pending) && local_clock() > deadline) {
+			block->time_budget_exhausted++;
+			reschedule = true;
+			break;
+		}
 	}
 
-	if (reschedule)
+	/* Never complete napi from netpoll */
+	if (reschedule || !budget)
 		return budget;
 
 	if (likely(napi_complete_done(napi, work_done))) {
+		/* Polled blocks keep the irq masked, see gve_poll_thread() */
+		if (READ_ONCE(block->polled))
+			return work_done;
+
 		/* Enable interrupts again.
 		 *
 		 * We don't need to repoll afterwards because HW supports the
@@ -391,10 +545,54 @@ static int gve_napi_poll_dqo(struct napi_struct *napi, int budget)
 	return work_done;
 }
 
+/* Pins a block's irq to a CPU. TX and RX blocks are each numbered from 0 so
+ * that tx and rx queue i land on the same CPU.
+ */
+static void gve_set_ntfy_blk_cpu(struct gve_priv *priv, u32 ntfy_idx)
+{
+	struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
+	u32 blk_idx = ntfy_idx;
+	u32 num_blks = priv->ntfy_tx_blks;
+
+	if (ntfy_idx >= priv->ntfy_tx_blks) {
+		blk_idx -= priv->ntfy_tx_blks;
+		num_blks = gve_ntfy_rx_blks(priv);
+	}
+	block->irq_cpu = blk_idx % min_t(u32, num_blks, num_online_cpus());
+	block->node = cpu_to_node(block->irq_cpu);
+	irq_set_affinity_hint(priv->msix_vectors[ntfy_idx].vector,
+			      get_cpu_mask(block->irq_cpu));
+}
+
+/* Splits the notify blocks between TX and RX in proportion to the queue
+ * counts, so that an asymmetric ethtool -L gets blocks of its own instead
+ * of sharing half of them. XDP rings rely on the even split.
+ */
+static void gve_set_ntfy_split(struct gve_priv *priv)
+{
+	u32 num_tx = priv->tx_cfg.num_queues;
+	u32 num_rx = priv->rx_cfg.num_queues;
+	u32 tx_blks = priv->num_ntfy_blks / 2;
+	u32 i;
+
+	if (!priv->num_xdp_queues)
+		tx_blks = clamp_t(u32, DIV_ROUND_CLOSEST(priv->num_ntfy_blks *
+							 num_tx,
+							 num_tx + num_rx),
+				  1, priv->num_ntfy_blks - 1);
+	if (tx_blks == priv->ntfy_tx_blks)
+		return;
+
+	priv->ntfy_tx_blks = tx_blks;
+	for (i = 0; i < priv->num_ntfy_blks; i++)
+		gve_set_ntfy_blk_cpu(priv, i);
+	dev_info(&priv->pdev->dev, "Notify blocks split %u tx, %u rx\n",
+		 priv->ntfy_tx_blks, gve_ntfy_rx_blks(priv));
+}
+
 static int gve_alloc_notify_blocks(struct gve_priv *priv)
 {
 	int num_vecs_requested = priv->num_ntfy_blks + 1;
-	unsigned int active_cpus;
 	int vecs_enabled;
 	int i, j;
 	int err;
@@ -415,26 +613,22 @@ static int gve_alloc_notify_blocks(struct gve_priv *priv)
 	}
 	if (vecs_enabled != num_vecs_requested) {
 		int new_num_ntfy_blks = (vecs_enabled - 1) & ~0x1;
-		int vecs_per_type = new_num_ntfy_blks / 2;
-		int vecs_left = new_num_ntfy_blks % 2;
 
+		/* Keep the queue counts and let queues share the notify
+		 * blocks we did get; gve_{tx,rx}_idx_to_ntfy spread them
+		 * round-robin and NAPI splits its budget between them.
+		 */
 		priv->num_ntfy_blks = new_num_ntfy_blks;
 		priv->mgmt_msix_idx = priv->num_ntfy_blks;
-		priv->tx_cfg.max_queues = min_t(int, priv->tx_cfg.max_queues,
-						vecs_per_type);
-		priv->rx_cfg.max_queues = min_t(int, priv->rx_cfg.max_queues,
-						vecs_per_type + vecs_left);
 		dev_err(&priv->pdev->dev,
-			"Could not enable desired msix, only enabled %d, adjusting tx max queues to %d, and rx max queues to %d\n",
-			vecs_enabled, priv->tx_cfg.max_queues,
-			priv->rx_cfg.max_queues);
-		if (priv->tx_cfg.num_queues > priv->tx_cfg.max_queues)
-			priv->tx_cfg.num_queues = priv->tx_cfg.max_queues;
-		if (priv->rx_cfg.num_queues > priv->rx_cfg.max_queues)
-			priv->rx_cfg.num_queues = priv->rx_cfg.max_queues;
+			"Could not enable desired msix, only enabled %d, sharing %d notify blocks between %d tx and %d rx max queues\n",
+			vecs_enabled, priv->num_ntfy_blks,
+			priv->tx_cfg.max_queues, priv->rx_cfg.max_queues);
 	}
-	/* Half the notification blocks go to TX and half to RX */
-	active_cpus = min_t(int, priv->num_ntfy_blks / 2, num_online_cpus());
+	/* Half the notification blocks go to TX and half to RX until the
+	 * next open sizes the split to the queue counts.
+	 */
+	priv->ntfy_tx_blks = priv->num_ntfy_blks / 2;
 
 	/* Setup Management Vector  - the last vector */
 	snprintf(priv->mgmt_msix_name, sizeof(priv->mgmt_msix_name), "gve-mgmnt@pci:%s",
@@ -478,8 +672,7 @@ static int gve_alloc_notify_blocks(struct gve_priv *priv)
 				"Failed to receive msix vector %d\n", i);
 			goto abort_with_some_ntfy_blocks;
 		}
-		irq_set_affinity_hint(priv->msix_vectors[msix_idx].vector,
-				      get_cpu_mask(i % active_cpus));
+		gve_set_ntfy_blk_cpu(priv, i);
 		block->irq_db_index = &priv->irq_db_indices[i].index;
 	}
 	return 0;
@@ -610,6 +803,11 @@ static void gve_teardown_device_resources(struct gve_priv *priv)
 {
 	int err;
 
+	/* Let pending async admin commands finish while the device can
+	 * still answer them.
+	 */
+	gve_adminq_async_drain(priv);
+
 	/* Tell device its resources are being freed */
 	if (gve_get_device_resources_ok(priv)) {
 		gve_flow_rules_reset(priv);
@@ -632,7 +830,9 @@ static void gve_teardown_device_resources(struct gve_priv *priv)
 	kvfree(priv->ptype_lut_dqo);
 	priv->ptype_lut_dqo = NULL;
 
+	mutex_lock(&priv->rss_config_lock);
 	gve_rss_config_release(&priv->rss_config);
+	mutex_unlock(&priv->rss_config_lock);
 	gve_free_counter_array(priv);
 	gve_free_notify_blocks(priv);
 	gve_free_stats_report(priv);
@@ -827,15 +1027,21 @@ static void add_napi_init_xdp_sync_stats(struct gve_priv *priv,
 							  int budget))
 {
 	int start_id = gve_xdp_tx_start_queue_id(priv);
+	int num_blks;
 	int i;
 
+	num_blks = gve_num_tx_ntfy_blks(priv, start_id + priv->num_xdp_queues);
 	/* Add xdp tx napi & init sync stats*/
 	for (i = start_id; i < start_id + priv->num_xdp_queues; i++) {
 		int ntfy_idx = gve_tx_idx_to_ntfy(priv, i);
 
 		u64_stats_init(&priv->tx[i].statss);
 		priv->tx[i].ntfy_id = ntfy_idx;
-		gve_add_napi(priv, ntfy_idx, napi_poll);
+		/* Only the first queue on a block registers its napi, and
+		 * colocated rings ride on their rx ring's napi.
+		 */
+		if (i < num_blks && !gve_xdp_tx_colocated(priv))
+			gve_add_napi(priv, ntfy_idx, napi_poll);
 	}
 }
 
@@ -876,15 +1082,22 @@ static void add_napi_init_sync_stats(struct gve_priv *priv,
 				     int (*napi_poll)(struct napi_struct *napi,
 						      int budget))
 {
+	int num_tx_blks, num_rx_blks;
 	int i;
 
-	/* Add tx napi & init sync stats*/
+	num_tx_blks = gve_num_tx_ntfy_blks(priv, gve_num_tx_ntfy_queues(priv));
+	num_rx_blks = gve_num_rx_ntfy_blks(priv, priv->rx_cfg.num_queues);
+
+	/* Add tx napi & init sync stats. Only the first queue on a block
+	 * registers its napi.
+	 */
 	for (i = 0; i < gve_num_tx_queues(priv); i++) {
 		int ntfy_idx = gve_tx_idx_to_ntfy(priv, i);
 
 		u64_stats_init(&priv->tx[i].statss);
 		priv->tx[i].ntfy_id = ntfy_idx;
-		gve_add_napi(priv, ntfy_idx, napi_poll);
+		if (i < num_tx_blks)
+			gve_add_napi(priv, ntfy_idx, napi_poll);
 	}
 	/* Add rx napi  & init sync stats*/
 	for (i = 0; i < priv->rx_cfg.num_queues; i++) {
@@ -892,7 +1105,8 @@ static void add_napi_init_sync_stats(struct gve_priv *priv,
 
 		u64_stats_init(&priv->rx[i].statss);
 		priv->rx[i].ntfy_id = ntfy_idx;
-		gve_add_napi(priv, ntfy_idx, napi_poll);
+		if (i < num_rx_blks)
+			gve_add_napi(priv, ntfy_idx, napi_poll);
 	}
 }
 
@@ -1043,12 +1257,15 @@ static void gve_rx_free_rings(struct gve_priv *priv)
 
 static void gve_free_xdp_rings(struct gve_priv *priv)
 {
-	int ntfy_idx, start_id;
+	int ntfy_idx, start_id, num_blks;
 	int i;
 
 	start_id = gve_xdp_tx_start_queue_id(priv);
+	num_blks = gve_num_tx_ntfy_blks(priv, start_id + priv->num_xdp_queues);
+	if (gve_xdp_tx_colocated(priv))
+		num_blks = 0;
 	if (priv->tx) {
-		for (i = start_id; i <  start_id + priv->num_xdp_queues; i++) {
+		for (i = start_id; i < num_blks; i++) {
 			ntfy_idx = gve_tx_idx_to_ntfy(priv, i);
 			gve_remove_napi(priv, ntfy_idx);
 		}
@@ -1062,8 +1279,13 @@ static void gve_free_rings(struct gve_priv *priv)
 	int ntfy_idx;
 	int i;
 
+	/* Let health dumps that saw device_rings_ok finish with the rings */
+	synchronize_rcu();
+
 	if (priv->tx) {
-		for (i = 0; i < num_tx_queues; i++) {
+		for (i = 0;
+		     i < gve_num_tx_ntfy_blks(priv, gve_num_tx_ntfy_queues(priv));
+		     i++) {
 			ntfy_idx = gve_tx_idx_to_ntfy(priv, i);
 			gve_remove_napi(priv, ntfy_idx);
 		}
@@ -1072,7 +1294,8 @@ static void gve_free_rings(struct gve_priv *priv)
 		priv->tx = NULL;
 	}
 	if (priv->rx) {
-		for (i = 0; i < priv->rx_cfg.num_queues; i++) {
+		for (i = 0; i < gve_num_rx_ntfy_blks(priv, priv->rx_cfg.num_queues);
+		     i++) {
 			ntfy_idx = gve_rx_idx_to_ntfy(priv, i);
 			gve_remove_napi(priv, ntfy_idx);
 		}
@@ -1100,6 +1323,37 @@ int gve_alloc_page(struct gve_priv *priv, struct device *dev,
 	return 0;
 }
 
+/* In confidential VM mode QPL pages are allocated already shared with the
+ * host. They need no streaming mapping, so syncs on them never bounce.
+ */
+static int gve_alloc_qpl_page(struct gve_priv *priv, struct page **page,
+			      dma_addr_t *dma, enum dma_data_direction dir)
+{
+	struct device *dev = &priv->pdev->dev;
+
+	if (!priv->cvm_mode)
+		return gve_alloc_page(priv, dev, page, dma, dir, GFP_KERNEL);
+
+	*page = dma_alloc_pages(dev, PAGE_SIZE, dma, dir, GFP_KERNEL);
+	if (!*page) {
+		priv->page_alloc_fail++;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void gve_free_qpl_page(struct gve_priv *priv, struct page *page,
+			      dma_addr_t dma, enum dma_data_direction dir)
+{
+	struct device *dev = &priv->pdev->dev;
+
+	if (!priv->cvm_mode) {
+		gve_free_page(dev, page, dma, dir);
+		return;
+	}
+	dma_free_pages(dev, PAGE_SIZE, page, dma, dir);
+}
+
 static int gve_alloc_queue_page_list(struct gve_priv *priv, u32 id,
 				     int pages)
 {
@@ -1127,9 +1381,9 @@ static int gve_alloc_queue_page_list(struct gve_priv *priv, u32 id,
 		return -ENOMEM;
 
 	for (i = 0; i < pages; i++) {
-		err = gve_alloc_page(priv, &priv->pdev->dev, &qpl->pages[i],
-				     &qpl->page_buses[i],
-				     gve_qpl_dma_dir(priv, id), GFP_KERNEL);
+		err = gve_alloc_qpl_page(priv, &qpl->pages[i],
+					 &qpl->page_buses[i],
+					 gve_qpl_dma_dir(priv, id));
 		/* caller handles clean up */
 		if (err)
 			return -ENOMEM;
@@ -1160,8 +1414,8 @@ static void gve_free_queue_page_list(struct gve_priv *priv, u32 id)
 		goto free_pages;
 
 	for (i = 0; i < qpl->num_entries; i++)
-		gve_free_page(&priv->pdev->dev, qpl->pages[i],
-			      qpl->page_buses[i], gve_qpl_dma_dir(priv, id));
+		gve_free_qpl_page(priv, qpl->pages[i], qpl->page_buses[i],
+				  gve_qpl_dma_dir(priv, id));
 
 	kvfree(qpl->page_buses);
 	qpl->page_buses = NULL;
@@ -1192,6 +1446,22 @@ free_qpls:
 	return err;
 }
 
+static int gve_tx_qpl_page_count(struct gve_priv *priv)
+{
+	return priv->queue_format == GVE_GQI_QPL_FORMAT ?
+		GVE_TX_PAGE_COUNT : priv->tx_pages_per_qpl;
+}
+
+/* For GQI_QPL number of pages allocated have 1:1 relationship with
+ * number of descriptors. For DQO, number of pages required are
+ * more than descriptors (because of out of order completions).
+ */
+static int gve_rx_qpl_page_count(struct gve_priv *priv)
+{
+	return priv->queue_format == GVE_GQI_QPL_FORMAT ?
+		priv->rx_desc_cnt : priv->rx_pages_per_qpl;
+}
+
 static int gve_alloc_qpls(struct gve_priv *priv)
 {
 	int max_queues = priv->tx_cfg.max_queues + priv->rx_cfg.max_queues;
@@ -1208,8 +1478,7 @@ static int gve_alloc_qpls(struct gve_priv *priv)
 		return -ENOMEM;
 
 	start_id = gve_tx_start_qpl_id(priv);
-	page_count = priv->queue_format == GVE_GQI_QPL_FORMAT ?
-		GVE_TX_PAGE_COUNT : priv->tx_pages_per_qpl;
+	page_count = gve_tx_qpl_page_count(priv);
 	for (i = start_id; i < start_id + gve_num_tx_qpls(priv); i++) {
 		err = gve_alloc_queue_page_list(priv, i, page_count);
 		if (err)
@@ -1217,13 +1486,7 @@ static int gve_alloc_qpls(struct gve_priv *priv)
 	}
 
 	start_id = gve_rx_start_qpl_id(priv);
-
-	/* For GQI_QPL number of pages allocated have 1:1 relationship with
-	 * number of descriptors. For DQO, number of pages required are
-	 * more than descriptors (because of out of order completions).
-	 */
-	page_count = priv->queue_format == GVE_GQI_QPL_FORMAT ?
-		priv->rx_desc_cnt : priv->rx_pages_per_qpl;
+	page_count = gve_rx_qpl_page_count(priv);
 	for (i = start_id; i < start_id + gve_num_rx_qpls(priv); i++) {
 		err = gve_alloc_queue_page_list(priv, i, page_count);
 		if (err)
@@ -1277,6 +1540,76 @@ static void gve_free_qpls(struct gve_priv *priv)
 	priv->qpls = NULL;
 }
 
+/* Returns true if every QPL slot holds exactly the pages the current queue
+ * config needs: the tx and rx QPLs sized as gve_alloc_qpls() would size
+ * them now, and nothing anywhere else.
+ */
+static bool gve_qpl_prealloc_fits(struct gve_priv *priv)
+{
+	int max_queues = priv->tx_cfg.max_queues + priv->rx_cfg.max_queues;
+	int tx_start = gve_tx_start_qpl_id(priv);
+	int rx_start = gve_rx_start_qpl_id(priv);
+	u32 want;
+	int i;
+
+	if (!gve_is_qpl(priv) || !priv->qpls)
+		return false;
+
+	for (i = 0; i < max_queues; i++) {
+		if (i >= tx_start && i < tx_start + gve_num_tx_qpls(priv))
+			want = gve_tx_qpl_page_count(priv);
+		else if (i >= rx_start && i < rx_start + gve_num_rx_qpls(priv))
+			want = gve_rx_qpl_page_count(priv);
+		else
+			want = 0;
+		if (priv->qpls[i].num_entries != want)
+			return false;
+	}
+	return true;
+}
+
+/* Allocates the QPLs for the config found at probe while the rest of the
+ * boot carries on. This runs without RTNL, so everything that changes the
+ * queue config while the device is down flushes it first, see
+ * gve_qpl_prealloc_flush(). gve_open allocates the QPLs itself if this
+ * failed or the config has changed since.
+ */
+static void gve_qpl_prealloc_task(struct work_struct *work)
+{
+	struct gve_priv *priv = container_of(work, struct gve_priv,
+					     qpl_prealloc_task);
+	ktime_t start = ktime_get();
+
+	if (gve_alloc_qpls(priv))
+		return;
+
+	priv->qpl_prealloc_us = ktime_us_delta(ktime_get(), start);
+	priv->qpls_preallocated = true;
+}
+
+/* Waits for the background QPL allocation. Call with RTNL held before
+ * changing the queue config it reads.
+ */
+void gve_qpl_prealloc_flush(struct gve_priv *priv)
+{
+	flush_work(&priv->qpl_prealloc_task);
+}
+
+/* Keeps the background allocation's QPLs if they fit the current config.
+ * Returns true if they were kept.
+ */
+static bool gve_qpl_prealloc_claim(struct gve_priv *priv)
+{
+	bool keep;
+
+	gve_qpl_prealloc_flush(priv);
+	keep = priv->qpls_preallocated && gve_qpl_prealloc_fits(priv);
+	priv->qpls_preallocated = false;
+	if (!keep)
+		gve_free_qpls(priv);
+	return keep;
+}
+
 /* Use this to schedule a reset when the device is capable of continuing
  * to handle other requests in its current state. If it is not, do a reset
  * in thread instead.
@@ -1388,16 +1721,23 @@ static void gve_drain_page_cache(struct gve_priv *priv)
 static int gve_open(struct net_device *dev)
 {
 	struct gve_priv *priv = netdev_priv(dev);
+	bool prealloc;
 	int err;
 
+	gve_qpl_prealloc_flush(priv);
 	if (priv->xdp_prog)
 		priv->num_xdp_queues = priv->rx_cfg.num_queues;
 	else
 		priv->num_xdp_queues = 0;
+	priv->xdp_tx_colocate = gve_get_xdp_tx_colocate(priv);
+	gve_set_ntfy_split(priv);
 
-	err = gve_alloc_qpls(priv);
-	if (err)
-		return err;
+	prealloc = gve_qpl_prealloc_claim(priv);
+	if (!prealloc) {
+		err = gve_alloc_qpls(priv);
+		if (err)
+			return err;
+	}
 
 	err = gve_alloc_rings(priv);
 	if (err)
@@ -1423,6 +1763,7 @@ static int gve_open(struct net_device *dev)
 		goto reset;
 
 	gve_set_device_rings_ok(priv);
+	gve_update_mem_hwm(priv);
 
 	if (gve_get_report_stats(priv))
 		mod_timer(&priv->stats_report_timer,
@@ -1436,6 +1777,18 @@ static int gve_open(struct net_device *dev)
 	gve_turnup(priv);
 	queue_work(priv->gve_wq, &priv->service_task);
 	priv->interface_up_cnt++;
+	if (!priv->first_open_done) {
+		if (prealloc)
+			dev_info(&priv->pdev->dev,
+				 "First open %lld us after probe start, using QPLs preallocated in %llu us\n",
+				 ktime_us_delta(ktime_get(), priv->probe_start),
+				 priv->qpl_prealloc_us);
+		else
+			dev_info(&priv->pdev->dev,
+				 "First open %lld us after probe start\n",
+				 ktime_us_delta(ktime_get(), priv->probe_start));
+		priv->first_open_done = true;
+	}
 	return 0;
 
 free_rings:
@@ -1501,6 +1854,7 @@ int gve_adjust_ring_sizes(struct gve_priv *priv,
 {
 	int err;
 
+	gve_qpl_prealloc_flush(priv);
 	if (netif_carrier_ok(priv->dev)) {
 		err = gve_close(priv->dev);
 		if (err)
@@ -1551,6 +1905,7 @@ static int gve_add_xdp_queues(struct gve_priv *priv)
 	int err;
 
 	priv->num_xdp_queues = priv->tx_cfg.num_queues;
+	priv->xdp_tx_colocate = gve_get_xdp_tx_colocate(priv);
 
 	err = gve_alloc_xdp_qpls(priv);
 	if (err)
@@ -1648,6 +2003,8 @@ int gve_reconfigure_rx_rings(struct gve_priv *priv,
 
 	/* Reset RX state and re-register with the device */
 	err = gve_recreate_rx_rings(priv);
+	if (!err)
+		gve_update_mem_hwm(priv);
 err:
 	gve_turnup_and_check_status(priv);
 	return err;
@@ -1674,6 +2031,7 @@ static int gve_set_xdp(struct gve_priv *priv, struct bpf_prog *prog,
 		err = gve_add_xdp_queues(priv);
 		if (err)
 			goto out;
+		gve_update_mem_hwm(priv);
 	} else if (old_prog && !prog) {
 		// Remove XDP TX queues if an XDP program is
 		// being uninstalled
@@ -1776,8 +2134,10 @@ static int gve_xsk_pool_disable(struct net_device *dev,
 	napi_rx = &priv->ntfy_blocks[priv->rx[qid].ntfy_id].napi;
 	napi_disable(napi_rx); /* make sure current rx poll is done */
 
+	/* A colocated tx ring shares the rx ring's napi */
 	napi_tx = &priv->ntfy_blocks[priv->tx[tx_qid].ntfy_id].napi;
-	napi_disable(napi_tx); /* make sure current tx poll is done */
+	if (napi_tx != napi_rx)
+		napi_disable(napi_tx); /* make sure current tx poll is done */
 
 	priv->rx[qid].xsk_pool = NULL;
 	xdp_rxq_info_unreg(&priv->rx[qid].xsk_rxq);
@@ -1788,7 +2148,8 @@ static int gve_xsk_pool_disable(struct net_device *dev,
 	if (gve_rx_work_pending(&priv->rx[qid]))
 		napi_schedule(napi_rx);
 
-	napi_enable(napi_tx);
+	if (napi_tx != napi_rx)
+		napi_enable(napi_tx);
 	if (gve_tx_clean_pending(priv, &priv->tx[tx_qid]))
 		napi_schedule(napi_tx);
 
@@ -1853,6 +2214,18 @@ static int verify_xdp_configuration(struct net_device *dev)
 			    priv->tx_cfg.max_queues);
 		return -EINVAL;
 	}
+
+	/* XDP and XSK rings rely on a dedicated notify block per tx queue,
+	 * unless they are colocated with their rx ring.
+	 */
+	if (!gve_get_xdp_tx_colocate(priv) &&
+	    2 * priv->tx_cfg.num_queues > priv->num_ntfy_blks / 2) {
+		netdev_warn(dev, "XDP load failed: %d RX/TX queues need %d TX notify blocks, only %d available\n",
+			    priv->tx_cfg.num_queues,
+			    2 * priv->tx_cfg.num_queues,
+			    priv->num_ntfy_blks / 2);
+		return -EINVAL;
+	}
 	return 0;
 }
 
@@ -1882,6 +2255,9 @@ int gve_flow_rules_reset(struct gve_priv *priv)
 	struct gve_flow_rule *cur, *next;
 	int err;
 
+	/* Queued adds/dels must reach the device before the reset does */
+	gve_adminq_async_drain(priv);
+
 	if (priv->flow_rules_cnt == 0)
 		return 0;
 
@@ -1889,11 +2265,13 @@ int gve_flow_rules_reset(struct gve_priv *priv)
 	if (err)
 		return err;
 
+	mutex_lock(&priv->flow_rules_lock);
 	list_for_each_entry_safe(cur, next, &priv->flow_rules, list) {
 		list_del(&cur->list);
 		kvfree(cur);
 		priv->flow_rules_cnt--;
 	}
+	mutex_unlock(&priv->flow_rules_lock);
 	return 0;
 }
 
@@ -1904,6 +2282,7 @@ static int gve_adjust_queue_count(struct gve_priv *priv,
 	struct gve_queue_config old_rx_config = priv->rx_cfg;
 	int err = 0;
 
+	gve_qpl_prealloc_flush(priv);
 	priv->rx_cfg = new_rx_config;
 	priv->tx_cfg = new_tx_config;
 
@@ -1955,6 +2334,160 @@ err:
 	return err;
 }
 
+/* Free-running count of rx descriptors and tx packets completed on the
+ * block, used by the polling thread to tell busy polls from idle ones.
+ */
+static u64 gve_ntfy_blk_activity(struct gve_notify_block *block)
+{
+	struct gve_tx_ring *tx;
+	struct gve_rx_ring *rx;
+	u64 activity = 0;
+
+	for (tx = block->tx; tx; tx = tx->ntfy_next)
+		activity += tx->pkt_done;
+	for (rx = block->rx; rx; rx = rx->ntfy_next)
+		activity += rx->cnt;
+	return activity;
+}
+
+/* Drives NAPI for a polled block from its irq CPU: polls back to back while
+ * there is work, spins for GVE_POLL_IDLE_SPINS idle polls and then sleeps
+ * with exponential backoff up to GVE_POLL_SLEEP_MAX_US.
+ */
+static int gve_poll_thread(void *arg)
+{
+	struct gve_notify_block *block = arg;
+	unsigned int sleep_us = 0;
+	int idle_polls = 0;
+	u64 activity;
+	u64 start;
+
+	while (!kthread_should_stop()) {
+		start = local_clock();
+		activity = gve_ntfy_blk_activity(block);
+
+		/* NAPI runs from the softirq raised here, on this CPU */
+		local_bh_disable();
+		napi_schedule(&block->napi);
+		local_bh_enable();
+
+		if (gve_ntfy_blk_activity(block) != activity) {
+			WRITE_ONCE(block->poll_busy_ns, block->poll_busy_ns +
+				   local_clock() - start);
+			idle_polls = 0;
+			sleep_us = 0;
+			cond_resched();
+		} else if (++idle_polls < GVE_POLL_IDLE_SPINS) {
+			cpu_relax();
+			cond_resched();
+		} else {
+			sleep_us = clamp_t(unsigned int, sleep_us * 2,
+					   GVE_POLL_SLEEP_MIN_US,
+					   GVE_POLL_SLEEP_MAX_US);
+			usleep_range(sleep_us, sleep_us + sleep_us / 2);
+		}
+		WRITE_ONCE(block->poll_run_ns, block->poll_run_ns +
+			   local_clock() - start);
+	}
+
+	return 0;
+}
+
+static bool gve_ntfy_blk_wants_polling(struct gve_priv *priv,
+				       struct gve_notify_block *block)
+{
+	struct gve_tx_ring *tx;
+	struct gve_rx_ring *rx;
+
+	if (!priv->polled_queues)
+		return false;
+
+	for (tx = block->tx; tx; tx = tx->ntfy_next)
+		if (tx->q_num < priv->tx_cfg.num_queues &&
+		    test_bit(tx->q_num, priv->polled_queues))
+			return true;
+	for (rx = block->rx; rx; rx = rx->ntfy_next)
+		if (test_bit(rx->q_num, priv->polled_queues))
+			return true;
+	return false;
+}
+
+static void gve_polled_start_block(struct gve_priv *priv, int ntfy_idx)
+{
+	struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
+	struct task_struct *task;
+
+	if (block->poll_task || !gve_ntfy_blk_wants_polling(priv, block))
+		return;
+
+	task = kthread_create(gve_poll_thread, block, "gve-poll/%d", ntfy_idx);
+	if (IS_ERR(task)) {
+		netif_err(priv, drv, priv->dev,
+			  "Failed to start polling thread for block %d: %ld\n",
+			  ntfy_idx, PTR_ERR(task));
+		return;
+	}
+	kthread_bind(task, block->irq_cpu);
+
+	WRITE_ONCE(block->polled, true);
+	if (gve_is_gqi(priv))
+		iowrite32be(GVE_IRQ_MASK, gve_irq_doorbell(priv, block));
+	else
+		gve_write_irq_doorbell_dqo(priv, block, GVE_ITR_NO_UPDATE_DQO);
+
+	block->poll_task = task;
+	wake_up_process(task);
+}
+
+/* Start polling threads for the blocks of the queues in polled_queues. Must
+ * run with NAPI enabled.
+ */
+static void gve_polled_start(struct gve_priv *priv)
+{
+	int idx;
+
+	for (idx = 0;
+	     idx < gve_num_tx_ntfy_blks(priv, gve_num_tx_ntfy_queues(priv));
+	     idx++)
+		gve_polled_start_block(priv, gve_tx_idx_to_ntfy(priv, idx));
+	for (idx = 0; idx < gve_num_rx_ntfy_blks(priv, priv->rx_cfg.num_queues);
+	     idx++)
+		gve_polled_start_block(priv, gve_rx_idx_to_ntfy(priv, idx));
+}
+
+/* Stop all polling threads. Each block gets one more NAPI run so that its
+ * poll completes the regular way and unmasks the irq.
+ */
+static void gve_polled_stop(struct gve_priv *priv)
+{
+	int i;
+
+	for (i = 0; i < priv->num_ntfy_blks; i++) {
+		struct gve_notify_block *block = &priv->ntfy_blocks[i];
+
+		if (!block->poll_task)
+			continue;
+
+		kthread_stop(block->poll_task);
+		block->poll_task = NULL;
+		WRITE_ONCE(block->polled, false);
+
+		local_bh_disable();
+		napi_schedule(&block->napi);
+		local_bh_enable();
+	}
+}
+
+/* Apply a new polled_queues set to a running device. Called under rtnl. */
+void gve_polled_update(struct gve_priv *priv)
+{
+	if (!gve_get_napi_enabled(priv))
+		return;
+
+	gve_polled_stop(priv);
+	gve_polled_start(priv);
+}
+
 static void gve_turndown(struct gve_priv *priv)
 {
 	int idx;
@@ -1965,14 +2498,19 @@ static void gve_turndown(struct gve_priv *priv)
 	if (!gve_get_napi_enabled(priv))
 		return;
 
+	gve_polled_stop(priv);
+
 	/* Disable napi to prevent more work from coming in */
-	for (idx = 0; idx < gve_num_tx_queues(priv); idx++) {
+	for (idx = 0;
+	     idx < gve_num_tx_ntfy_blks(priv, gve_num_tx_ntfy_queues(priv));
+	     idx++) {
 		int ntfy_idx = gve_tx_idx_to_ntfy(priv, idx);
 		struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 
 		napi_disable(&block->napi);
 	}
-	for (idx = 0; idx < priv->rx_cfg.num_queues; idx++) {
+	for (idx = 0; idx < gve_num_rx_ntfy_blks(priv, priv->rx_cfg.num_queues);
+	     idx++) {
 		int ntfy_idx = gve_rx_idx_to_ntfy(priv, idx);
 		struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 
@@ -1994,7 +2532,9 @@ static void gve_turnup(struct gve_priv *priv)
 	netif_tx_start_all_queues(priv->dev);
 
 	/* Enable napi and unmask interrupts for all queues */
-	for (idx = 0; idx < gve_num_tx_queues(priv); idx++) {
+	for (idx = 0;
+	     idx < gve_num_tx_ntfy_blks(priv, gve_num_tx_ntfy_queues(priv));
+	     idx++) {
 		int ntfy_idx = gve_tx_idx_to_ntfy(priv, idx);
 		struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 
@@ -2006,7 +2546,8 @@ static void gve_turnup(struct gve_priv *priv)
 						       priv->tx_coalesce_usecs);
 		}
 	}
-	for (idx = 0; idx < priv->rx_cfg.num_queues; idx++) {
+	for (idx = 0; idx < gve_num_rx_ntfy_blks(priv, priv->rx_cfg.num_queues);
+	     idx++) {
 		int ntfy_idx = gve_rx_idx_to_ntfy(priv, idx);
 		struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 
@@ -2020,6 +2561,7 @@ static void gve_turnup(struct gve_priv *priv)
 	}
 
 	gve_set_napi_enabled(priv);
+	gve_polled_start(priv);
 }
 
 static void gve_tx_timeout(struct net_device *dev, unsigned int txqueue)
@@ -2041,7 +2583,7 @@ static void gve_tx_timeout(struct net_device *dev, unsigned int txqueue)
 		goto reset;
 
 	block = &priv->ntfy_blocks[ntfy_idx];
-	tx = block->tx;
+	tx = &priv->tx[txqueue];
 
 	current_time = jiffies_to_msecs(jiffies);
 	if (tx->last_kick_msec + MIN_TX_TIMEOUT_GAP > current_time)
@@ -2060,7 +2602,7 @@ static void gve_tx_timeout(struct net_device *dev, unsigned int txqueue)
 	} // Else reset.
 
 reset:
-	gve_schedule_reset(priv);
+	gve_health_report_tx_timeout(priv, txqueue);
 
 out:
 	if (tx)
@@ -2107,6 +2649,38 @@ err:
 	return err;
 }
 
+static int gve_hwtstamp_get(struct net_device *dev,
+			    struct kernel_hwtstamp_config *config)
+{
+	struct gve_priv *priv = netdev_priv(dev);
+
+	config->tx_type = HWTSTAMP_TX_OFF;
+	config->rx_filter = priv->rx_tstamp_enabled ? HWTSTAMP_FILTER_ALL :
+						      HWTSTAMP_FILTER_NONE;
+	return 0;
+}
+
+/* The device has no clock. RX "hardware" timestamps are host times taken
+ * when the driver reads the packet's completion, which separates the time
+ * spent queued in the driver from the time spent in the stack.
+ */
+static int gve_hwtstamp_set(struct net_device *dev,
+			    struct kernel_hwtstamp_config *config,
+			    struct netlink_ext_ack *extack)
+{
+	struct gve_priv *priv = netdev_priv(dev);
+
+	if (config->tx_type != HWTSTAMP_TX_OFF) {
+		NL_SET_ERR_MSG_MOD(extack, "TX hardware timestamps are not supported");
+		return -ERANGE;
+	}
+
+	if (config->rx_filter != HWTSTAMP_FILTER_NONE)
+		config->rx_filter = HWTSTAMP_FILTER_ALL;
+	gve_set_rx_tstamp(priv, config->rx_filter == HWTSTAMP_FILTER_ALL);
+	return 0;
+}
+
 static const struct net_device_ops gve_netdev_ops = {
 	.ndo_start_xmit		=	gve_start_xmit,
 	.ndo_open		=	gve_open,
@@ -2117,6 +2691,8 @@ static const struct net_device_ops gve_netdev_ops = {
 	.ndo_bpf		=	gve_xdp,
 	.ndo_xdp_xmit		=	gve_xdp_xmit,
 	.ndo_xsk_wakeup		=	gve_xsk_wakeup,
+	.ndo_hwtstamp_get	=	gve_hwtstamp_get,
+	.ndo_hwtstamp_set	=	gve_hwtstamp_set,
 };
 
 static void gve_handle_status(struct gve_priv *priv, u32 status)
@@ -2307,16 +2883,22 @@ static int gve_init_priv(struct gve_priv *priv, bool skip_describe_device)
 	priv->num_ntfy_blks = (num_ntfy - 1) & ~0x1;
 	priv->mgmt_msix_idx = priv->num_ntfy_blks;
 
-	spin_lock_init(&priv->flow_rules_lock);
+	mutex_init(&priv->flow_rules_lock);
+	mutex_init(&priv->rss_config_lock);
 	INIT_LIST_HEAD(&priv->flow_rules);
 
+	/* Default to an even split of the blocks, but let ethtool -L give
+	 * either direction all but one of them.
+	 */
 	priv->tx_cfg.max_queues =
-		min_t(int, priv->tx_cfg.max_queues, priv->num_ntfy_blks / 2);
+		min_t(int, priv->tx_cfg.max_queues, priv->num_ntfy_blks - 1);
 	priv->rx_cfg.max_queues =
-		min_t(int, priv->rx_cfg.max_queues, priv->num_ntfy_blks / 2);
+		min_t(int, priv->rx_cfg.max_queues, priv->num_ntfy_blks - 1);
 
-	priv->tx_cfg.num_queues = priv->tx_cfg.max_queues;
-	priv->rx_cfg.num_queues = priv->rx_cfg.max_queues;
+	priv->tx_cfg.num_queues =
+		min_t(int, priv->tx_cfg.max_queues, priv->num_ntfy_blks / 2);
+	priv->rx_cfg.num_queues =
+		min_t(int, priv->rx_cfg.max_queues, priv->num_ntfy_blks / 2);
 	if (priv->default_num_queues > 0) {
 		priv->tx_cfg.num_queues = min_t(int, priv->default_num_queues,
 						priv->tx_cfg.num_queues);
@@ -2520,7 +3102,18 @@ static int gve_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	priv->state_flags = 0x0;
 	priv->ethtool_flags = 0x0;
 	priv->ethtool_defaults = 0x0;
-
+	priv->napi_tx_weight_dqo = GVE_NAPI_TX_WEIGHT_DQO;
+	priv->napi_rx_weight_dqo = GVE_NAPI_RX_WEIGHT_DQO;
+	priv->tx_wake_thresh_gqi = GVE_TX_WAKE_THRESH_DEFAULT;
+	priv->tx_wake_thresh_dqo = GVE_TX_WAKE_THRESH_DEFAULT;
+	priv->queue_format_pref = queue_format;
+	priv->rx_node_pool_enabled = rx_node_pool;
+	priv->tx_sg_map = tx_sg_map;
+	priv->cvm_mode = gve_use_cvm_mode();
+	if (priv->cvm_mode)
+		dev_info(&pdev->dev, "Confidential VM mode enabled\n");
+
+	priv->probe_start = ktime_get();
 	gve_set_probe_in_progress(priv);
 	priv->gve_wq = alloc_ordered_workqueue("gve", 0);
 	if (!priv->gve_wq) {
@@ -2530,6 +3123,8 @@ static int gve_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	}
 	INIT_WORK(&priv->service_task, gve_service_task);
 	INIT_WORK(&priv->stats_report_task, gve_stats_report_task);
+	INIT_WORK(&priv->qpl_prealloc_task, gve_qpl_prealloc_task);
+	gve_adminq_async_init(priv);
 	priv->tx_cfg.max_queues = max_tx_queues;
 	priv->rx_cfg.max_queues = max_rx_queues;
 
@@ -2537,17 +3132,28 @@ static int gve_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	if (err)
 		goto abort_with_wq;
 
+	if (gve_is_qpl(priv))
+		queue_work(system_unbound_wq, &priv->qpl_prealloc_task);
+
 	err = register_netdev(dev);
 	if (err)
 		goto abort_with_gve_init;
 
+	/* Health reporting is best effort, errors fall back to a plain reset */
+	if (gve_devlink_register(priv))
+		dev_warn(&pdev->dev, "Failed to register devlink\n");
+
 	dev_info(&pdev->dev, "GVE version %s\n", gve_version_str);
 	dev_info(&pdev->dev, "GVE queue format %d\n", (int)priv->queue_format);
+	dev_info(&pdev->dev, "Probe took %lld us\n",
+		 ktime_us_delta(ktime_get(), priv->probe_start));
 	gve_clear_probe_in_progress(priv);
 	queue_work(priv->gve_wq, &priv->service_task);
 	return 0;
 
 abort_with_gve_init:
+	cancel_work_sync(&priv->qpl_prealloc_task);
+	gve_free_qpls(priv);
 	gve_teardown_priv_resources(priv);
 
 abort_with_wq:
@@ -2578,6 +3184,13 @@ static void gve_remove(struct pci_dev *pdev)
 	void __iomem *reg_bar = priv->reg_bar0;
 
 	unregister_netdev(netdev);
+	/* Frees the QPLs allocated at probe if the device was never opened */
+	cancel_work_sync(&priv->qpl_prealloc_task);
+	gve_free_qpls(priv);
+	gve_devlink_unregister(priv);
+	rtnl_lock();
+	gve_set_rx_tstamp(priv, false);
+	rtnl_unlock();
 	gve_teardown_priv_resources(priv);
 	destroy_workqueue(priv->gve_wq);
 	free_netdev(netdev);
@@ -2639,12 +3252,12 @@ static int gve_resume(struct pci_dev *pdev)
 }
 #endif /* CONFIG_PM */
 
-void gve_rss_set_default_indir(struct gve_priv *priv)
+void gve_rss_set_default_indir(struct gve_priv *priv,
+			       struct gve_rss_config *rss_config)
 {
-	struct gve_rss_config *rss_config = &priv->rss_config;
 	int i;
 
-	for (i = 0; i < GVE_RSS_INDIR_SIZE; i++)
+	for (i = 0; i < rss_config->indir_size; i++)
 		rss_config->indir[i] = i % priv->rx_cfg.num_queues;
 }
 
@@ -2655,35 +3268,46 @@ void gve_rss_config_release(struct gve_rss_config *rss_config)
 	memset(rss_config, 0, sizeof(*rss_config));
 }
 
-int gve_rss_config_init(struct gve_priv *priv)
+/* Replace priv->rss_config with @rss_config, which the device has already
+ * accepted. Ownership of @rss_config's buffers moves to priv.
+ */
+void gve_rss_config_commit(struct gve_priv *priv,
+			   struct gve_rss_config *rss_config)
 {
-	struct gve_rss_config *rss_config = &priv->rss_config;
-
-	gve_rss_config_release(rss_config);
-
-	rss_config->key = kvzalloc(GVE_RSS_KEY_SIZE, GFP_KERNEL);
-	if (!rss_config->key)
-		goto err;
-
-	netdev_rss_key_fill(rss_config->key, GVE_RSS_KEY_SIZE);
+	mutex_lock(&priv->rss_config_lock);
+	gve_rss_config_release(&priv->rss_config);
+	priv->rss_config = *rss_config;
+	mutex_unlock(&priv->rss_config_lock);
+	memset(rss_config, 0, sizeof(*rss_config));
+}
 
-	rss_config->indir = kvcalloc(GVE_RSS_INDIR_SIZE,
-				     sizeof(*rss_config->indir),
-				     GFP_KERNEL);
-	if (!rss_config->indir)
-		goto err;
+int gve_rss_config_init(struct gve_priv *priv)
+{
+	struct gve_rss_config rss_config = {};
+	int err;
 
-	rss_config->alg = GVE_RSS_HASH_TOEPLITZ;
-	rss_config->key_size = GVE_RSS_KEY_SIZE;
-	rss_config->indir_size = GVE_RSS_INDIR_SIZE;
-	gve_rss_set_default_indir(priv);
+	rss_config.key = kvzalloc(GVE_RSS_KEY_SIZE, GFP_KERNEL);
+	rss_config.indir = kvcalloc(GVE_RSS_INDIR_SIZE,
+				    sizeof(*rss_config.indir),
+				    GFP_KERNEL);
+	if (!rss_config.key || !rss_config.indir) {
+		err = -ENOMEM;
+		goto out;
+	}
 
-	return gve_adminq_configure_rss(priv, rss_config);
+	netdev_rss_key_fill(rss_config.key, GVE_RSS_KEY_SIZE);
+	rss_config.alg = GVE_RSS_HASH_TOEPLITZ;
+	rss_config.key_size = GVE_RSS_KEY_SIZE;
+	rss_config.indir_size = GVE_RSS_INDIR_SIZE;
+	gve_rss_set_default_indir(priv, &rss_config);
 
-err:
-	kvfree(rss_config->key);
-	rss_config->key = NULL;
-	return -ENOMEM;
+	/* Only keep the new config once the device has taken it. */
+	err = gve_adminq_configure_rss(priv, &rss_config);
+	if (!err)
+		gve_rss_config_commit(priv, &rss_config);
+out:
+	gve_rss_config_release(&rss_config);
+	return err;
 }
 
 static const struct pci_device_id gve_id_table[] = {
@@ -2697,6 +3321,7 @@ static struct pci_driver gvnic_driver = {
 	.probe		= gve_probe,
 	.remove		= gve_remove,
 	.shutdown	= gve_shutdown,
+	.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 #ifdef CONFIG_PM
 	.suspend        = gve_suspend,
 	.resume         = gve_resume,
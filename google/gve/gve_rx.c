@@ -191,6 +191,19 @@ static void gve_rx_ctx_clear(struct gve_rx_ctx *ctx)
 	ctx->total_size = 0;
 	ctx->frag_cnt = 0;
 	ctx->drop_pkt = false;
+	ctx->flow_sort = false;
+}
+
+/* Frees the partly built skb of a packet being dropped */
+static void gve_rx_free_frags(struct napi_struct *napi, struct gve_rx_ctx *ctx)
+{
+	if (ctx->flow_sort) {
+		dev_kfree_skb_any(ctx->skb_head);
+		ctx->skb_head = NULL;
+		ctx->skb_tail = NULL;
+	} else {
+		napi_free_frags(napi);
+	}
 }
 
 static int gve_rx_alloc_ring(struct gve_priv *priv, int idx)
@@ -292,6 +305,42 @@ abort_with_slots:
 	return err;
 }
 
+static bool gve_rx_page_pinned(struct gve_rx_slot_page_info *page_info)
+{
+	return page_info->page &&
+	       page_count(page_info->page) > page_info->pagecnt_bias;
+}
+
+void gve_rx_get_mem_usage(struct gve_rx_ring *rx, struct gve_mem_usage *usage)
+{
+	u32 pool_size = rx->qpl_copy_pool_mask + 1;
+	u32 slots = rx->mask + 1;
+	u64 pinned = 0;
+	u32 i;
+
+	memset(usage, 0, sizeof(*usage));
+	usage->bytes[GVE_MEM_DESC] = slots * (sizeof(*rx->desc.desc_ring) +
+					      sizeof(*rx->data.data_ring)) +
+				     sizeof(*rx->q_resources);
+	usage->bytes[GVE_MEM_BOOKKEEPING] = (slots + pool_size) *
+					    sizeof(*rx->data.page_info);
+	if (rx->data.raw_addressing) {
+		usage->bytes[GVE_MEM_DATA] = (u64)slots * PAGE_SIZE;
+	} else {
+		usage->bytes[GVE_MEM_DATA] =
+			(u64)rx->data.qpl->num_entries * PAGE_SIZE;
+		usage->bytes[GVE_MEM_COPY_POOL] = (u64)pool_size * PAGE_SIZE;
+		for (i = 0; i < pool_size; i++)
+			if (gve_rx_page_pinned(&rx->qpl_copy_pool[i]))
+				pinned += PAGE_SIZE;
+	}
+
+	for (i = 0; i < slots; i++)
+		if (gve_rx_page_pinned(&rx->data.page_info[i]))
+			pinned += PAGE_SIZE;
+	usage->bytes[GVE_MEM_PINNED] = pinned;
+}
+
 int gve_rx_alloc_rings(struct gve_priv *priv)
 {
 	int err = 0;
@@ -342,7 +391,7 @@ static enum pkt_hash_types gve_rss_type(__be16 pkt_flags)
 
 static struct sk_buff *gve_rx_add_frags(struct napi_struct *napi,
 					struct gve_rx_slot_page_info *page_info,
-					u16 packet_buffer_size, u16 len,
+					u32 truesize, u16 len,
 					struct gve_rx_ctx *ctx)
 {
 	u32 offset = page_info->page_offset + page_info->pad;
@@ -350,7 +399,7 @@ static struct sk_buff *gve_rx_add_frags(struct napi_struct *napi,
 	int num_frags = 0;
 
 	if (!skb) {
-		skb = napi_get_frags(napi);
+		skb = gve_rx_get_frags(napi, ctx->flow_sort);
 		if (unlikely(!skb))
 			return NULL;
 
@@ -375,10 +424,10 @@ static struct sk_buff *gve_rx_add_frags(struct napi_struct *napi,
 	if (skb != ctx->skb_head) {
 		ctx->skb_head->len += len;
 		ctx->skb_head->data_len += len;
-		ctx->skb_head->truesize += packet_buffer_size;
+		ctx->skb_head->truesize += truesize;
 	}
 	skb_add_rx_frag(skb, num_frags, page_info->page,
-			offset, len, packet_buffer_size);
+			offset, len, truesize);
 
 	return ctx->skb_head;
 }
@@ -430,7 +479,8 @@ gve_rx_raw_addressing(struct device *dev, struct net_device *netdev,
 
 static struct sk_buff *gve_rx_copy_to_pool(struct gve_rx_ring *rx,
 					   struct gve_rx_slot_page_info *page_info,
-					   u16 len, struct napi_struct *napi)
+					   u16 len, struct napi_struct *napi,
+					   struct gve_rx_cnts *cnts)
 {
 	u32 pool_idx = rx->qpl_copy_pool_head & rx->qpl_copy_pool_mask;
 	void *src = page_info->page_address + page_info->page_offset;
@@ -453,6 +503,7 @@ static struct sk_buff *gve_rx_copy_to_pool(struct gve_rx_ring *rx,
 
 	if (alloc_page) {
 		struct gve_rx_slot_page_info alloc_page_info;
+		u32 offset, truesize;
 		struct page *page;
 
 		/* The least recently used page turned out to be
@@ -461,24 +512,25 @@ static struct sk_buff *gve_rx_copy_to_pool(struct gve_rx_ring *rx,
 		 */
 		rx->qpl_copy_pool_head++;
 
-		page = alloc_page(GFP_ATOMIC);
+		page = gve_rx_copy_frag(src + page_info->pad, len, &offset,
+					&truesize);
 		if (!page)
 			return NULL;
 
 		alloc_page_info.page = page;
-		alloc_page_info.page_offset = 0;
+		alloc_page_info.page_offset = offset;
 		alloc_page_info.page_address = page_address(page);
-		alloc_page_info.pad = page_info->pad;
+		alloc_page_info.pad = 0;
 
-		memcpy(alloc_page_info.page_address, src, page_info->pad + len);
-		skb = gve_rx_add_frags(napi, &alloc_page_info,
-				       rx->packet_buffer_size,
-				       len, ctx);
+		skb = gve_rx_add_frags(napi, &alloc_page_info, truesize, len,
+				       ctx);
+		if (unlikely(!skb)) {
+			put_page(page);
+			return NULL;
+		}
 
-		u64_stats_update_begin(&rx->statss);
-		rx->rx_frag_copy_cnt++;
-		rx->rx_frag_alloc_cnt++;
-		u64_stats_update_end(&rx->statss);
+		cnts->frag_copy_cnt++;
+		cnts->frag_alloc_cnt++;
 
 		return skb;
 	}
@@ -507,9 +559,7 @@ static struct sk_buff *gve_rx_copy_to_pool(struct gve_rx_ring *rx,
 		copy_page_info->can_flip = true;
 	}
 
-	u64_stats_update_begin(&rx->statss);
-	rx->rx_frag_copy_cnt++;
-	u64_stats_update_end(&rx->statss);
+	cnts->frag_copy_cnt++;
 
 	return skb;
 }
@@ -518,7 +568,7 @@ static struct sk_buff *
 gve_rx_qpl(struct device *dev, struct net_device *netdev,
 	   struct gve_rx_ring *rx, struct gve_rx_slot_page_info *page_info,
 	   u16 len, struct napi_struct *napi,
-	   union gve_rx_data_slot *data_slot)
+	   union gve_rx_data_slot *data_slot, struct gve_rx_cnts *cnts)
 {
 	struct gve_rx_ctx *ctx = &rx->ctx;
 	struct sk_buff *skb;
@@ -537,7 +587,7 @@ gve_rx_qpl(struct device *dev, struct net_device *netdev,
 			gve_rx_flip_buff(page_info, &data_slot->qpl_offset);
 		}
 	} else {
-		skb = gve_rx_copy_to_pool(rx, page_info, len, napi);
+		skb = gve_rx_copy_to_pool(rx, page_info, len, napi, cnts);
 	}
 	return skb;
 }
@@ -545,7 +595,7 @@ gve_rx_qpl(struct device *dev, struct net_device *netdev,
 static struct sk_buff *gve_rx_skb(struct gve_priv *priv, struct gve_rx_ring *rx,
 				  struct gve_rx_slot_page_info *page_info, struct napi_struct *napi,
 				  u16 len, union gve_rx_data_slot *data_slot,
-				  bool is_only_frag)
+				  bool is_only_frag, struct gve_rx_cnts *cnts)
 {
 	struct net_device *netdev = priv->dev;
 	struct gve_rx_ctx *ctx = &rx->ctx;
@@ -555,11 +605,9 @@ static struct sk_buff *gve_rx_skb(struct gve_priv *priv, struct gve_rx_ring *rx,
 		/* Just copy small packets */
 		skb = gve_rx_copy(netdev, napi, page_info, len);
 		if (skb) {
-			u64_stats_update_begin(&rx->statss);
-			rx->rx_copied_pkt++;
-			rx->rx_frag_copy_cnt++;
-			rx->rx_copybreak_pkt++;
-			u64_stats_update_end(&rx->statss);
+			cnts->copied_pkt_cnt++;
+			cnts->frag_copy_cnt++;
+			cnts->copybreak_pkt_cnt++;
 		}
 	} else {
 		int recycle = gve_rx_can_recycle_buffer(page_info);
@@ -568,12 +616,12 @@ static struct sk_buff *gve_rx_skb(struct gve_priv *priv, struct gve_rx_ring *rx,
 			gve_schedule_reset(priv);
 			return NULL;
 		}
-		page_info->can_flip = recycle;
-		if (page_info->can_flip) {
-			u64_stats_update_begin(&rx->statss);
-			rx->rx_frag_flip_cnt++;
-			u64_stats_update_end(&rx->statss);
-		}
+		/* QPL pages shared with the host in confidential VM mode are
+		 * never handed to the stack; their data is copied out.
+		 */
+		page_info->can_flip = recycle &&
+				      (rx->data.raw_addressing || !priv->cvm_mode);
+		cnts->frag_flip_cnt += page_info->can_flip;
 
 		if (rx->data.raw_addressing) {
 			skb = gve_rx_raw_addressing(&priv->pdev->dev, netdev,
@@ -582,7 +630,7 @@ static struct sk_buff *gve_rx_skb(struct gve_priv *priv, struct gve_rx_ring *rx,
 						    rx->packet_buffer_size, ctx);
 		} else {
 			skb = gve_rx_qpl(&priv->pdev->dev, netdev, rx,
-					 page_info, len, napi, data_slot);
+					 page_info, len, napi, data_slot, cnts);
 		}
 	}
 	return skb;
@@ -591,7 +639,8 @@ static struct sk_buff *gve_rx_skb(struct gve_priv *priv, struct gve_rx_ring *rx,
 static int gve_xsk_pool_redirect(struct net_device *dev,
 				 struct gve_rx_ring *rx,
 				 void *data, int len,
-				 struct bpf_prog *xdp_prog)
+				 struct bpf_prog *xdp_prog,
+				 struct gve_rx_cnts *cnts)
 {
 	struct xdp_buff *xdp;
 	int err;
@@ -600,9 +649,7 @@ static int gve_xsk_pool_redirect(struct net_device *dev,
 		return -E2BIG;
 	xdp = xsk_buff_alloc(rx->xsk_pool);
 	if (!xdp) {
-		u64_stats_update_begin(&rx->statss);
-		rx->xdp_alloc_fails++;
-		u64_stats_update_end(&rx->statss);
+		cnts->xdp_alloc_fails++;
 		return -ENOMEM;
 	}
 	xdp->data_end = xdp->data + len;
@@ -614,7 +661,8 @@ static int gve_xsk_pool_redirect(struct net_device *dev,
 }
 
 static int gve_xdp_redirect(struct net_device *dev, struct gve_rx_ring *rx,
-			    struct xdp_buff *orig, struct bpf_prog *xdp_prog)
+			    struct xdp_buff *orig, struct bpf_prog *xdp_prog,
+			    struct gve_rx_cnts *cnts)
 {
 	int total_len, len = orig->data_end - orig->data;
 	int headroom = XDP_PACKET_HEADROOM;
@@ -624,15 +672,13 @@ static int gve_xdp_redirect(struct net_device *dev, struct gve_rx_ring *rx,
 
 	if (rx->xsk_pool)
 		return gve_xsk_pool_redirect(dev, rx, orig->data,
-					     len, xdp_prog);
+					     len, xdp_prog, cnts);
 
 	total_len = headroom + SKB_DATA_ALIGN(len) +
 		SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 	frame = page_frag_alloc(&rx->page_cache, total_len, GFP_ATOMIC);
 	if (!frame) {
-		u64_stats_update_begin(&rx->statss);
-		rx->xdp_alloc_fails++;
-		u64_stats_update_end(&rx->statss);
+		cnts->xdp_alloc_fails++;
 		return -ENOMEM;
 	}
 	xdp_init_buff(&new, total_len, &rx->xdp_rxq);
@@ -648,7 +694,7 @@ static int gve_xdp_redirect(struct net_device *dev, struct gve_rx_ring *rx,
 
 static void gve_xdp_done(struct gve_priv *priv, struct gve_rx_ring *rx,
 			 struct xdp_buff *xdp, struct bpf_prog *xprog,
-			 int xdp_act)
+			 int xdp_act, struct gve_rx_cnts *cnts)
 {
 	struct gve_tx_ring *tx;
 	int tx_qid;
@@ -667,26 +713,18 @@ static void gve_xdp_done(struct gve_priv *priv, struct gve_rx_ring *rx,
 				       xdp->data_end - xdp->data, NULL);
 		spin_unlock(&tx->xdp_lock);
 
-		if (unlikely(err)) {
-			u64_stats_update_begin(&rx->statss);
-			rx->xdp_tx_errors++;
-			u64_stats_update_end(&rx->statss);
-		}
+		if (unlikely(err))
+			cnts->xdp_tx_errors++;
 		break;
 	case XDP_REDIRECT:
-		err = gve_xdp_redirect(priv->dev, rx, xdp, xprog);
+		err = gve_xdp_redirect(priv->dev, rx, xdp, xprog, cnts);
 
-		if (unlikely(err)) {
-			u64_stats_update_begin(&rx->statss);
-			rx->xdp_redirect_errors++;
-			u64_stats_update_end(&rx->statss);
-		}
+		if (unlikely(err))
+			cnts->xdp_redirect_errors++;
 		break;
 	}
-	u64_stats_update_begin(&rx->statss);
 	if ((u32)xdp_act < GVE_XDP_ACTIONS)
-		rx->xdp_actions[xdp_act]++;
-	u64_stats_update_end(&rx->statss);
+		cnts->xdp_actions[xdp_act]++;
 }
 
 #define GVE_PKTCONT_BIT_IS_SET(x) (GVE_RXF_PKT_CONT & (x))
@@ -718,7 +756,8 @@ static void gve_rx(struct gve_rx_ring *rx, netdev_features_t feat,
 	if (desc->flags_seq & GVE_RXF_ERR) {
 		ctx->drop_pkt = true;
 		cnts->desc_err_pkt_cnt++;
-		napi_free_frags(napi);
+		gve_rx_free_frags(napi, ctx);
+		gve_drop_pkt(priv->dev, rx->q_num, true, NULL, GVE_DROP_DESC_ERR);
 		goto finish_frag;
 	}
 
@@ -726,8 +765,9 @@ static void gve_rx(struct gve_rx_ring *rx, netdev_features_t feat,
 		netdev_warn(priv->dev, "Unexpected frag size %d, can't exceed %d, scheduling reset",
 			    frag_size, rx->packet_buffer_size);
 		ctx->drop_pkt = true;
-		napi_free_frags(napi);
-		gve_schedule_reset(rx->gve);
+		gve_rx_free_frags(napi, ctx);
+		gve_drop_pkt(priv->dev, rx->q_num, true, NULL, GVE_DROP_DESC_ERR);
+		gve_health_report_rx_err(priv, rx->q_num, "Unexpected RX frag size");
 		goto finish_frag;
 	}
 
@@ -761,7 +801,7 @@ static void gve_rx(struct gve_rx_ring *rx, netdev_features_t feat,
 		old_data = xdp.data;
 		xdp_act = bpf_prog_run_xdp(xprog, &xdp);
 		if (xdp_act != XDP_PASS) {
-			gve_xdp_done(priv, rx, &xdp, xprog, xdp_act);
+			gve_xdp_done(priv, rx, &xdp, xprog, xdp_act, cnts);
 			ctx->total_size += frag_size;
 			goto finish_ok_pkt;
 		}
@@ -769,19 +809,17 @@ static void gve_rx(struct gve_rx_ring *rx, netdev_features_t feat,
 		page_info->pad += xdp.data - old_data;
 		len = xdp.data_end - xdp.data;
 
-		u64_stats_update_begin(&rx->statss);
-		rx->xdp_actions[XDP_PASS]++;
-		u64_stats_update_end(&rx->statss);
+		cnts->xdp_actions[XDP_PASS]++;
 	}
 
 	skb = gve_rx_skb(priv, rx, page_info, napi, len,
-			 data_slot, is_only_frag);
+			 data_slot, is_only_frag, cnts);
 	if (!skb) {
-		u64_stats_update_begin(&rx->statss);
-		rx->rx_skb_alloc_fail++;
-		u64_stats_update_end(&rx->statss);
+		cnts->skb_alloc_fail_cnt++;
 
-		napi_free_frags(napi);
+		gve_rx_free_frags(napi, ctx);
+		gve_drop_pkt(priv->dev, rx->q_num, true, NULL,
+			     GVE_DROP_ALLOC_FAIL);
 		ctx->drop_pkt = true;
 		goto finish_frag;
 	}
@@ -806,10 +844,8 @@ static void gve_rx(struct gve_rx_ring *rx, netdev_features_t feat,
 
 	if (is_last_frag) {
 		skb_record_rx_queue(skb, rx->q_num);
-		if (skb_is_nonlinear(skb))
-			napi_gro_frags(napi);
-		else
-			napi_gro_receive(napi, skb);
+		gve_rx_tstamp_skb(rx, skb);
+		gve_rx_gro(rx, napi, skb, ctx->flow_sort, cnts);
 		goto finish_ok_pkt;
 	}
 
@@ -900,13 +936,13 @@ static bool gve_rx_refill_buffers(struct gve_priv *priv, struct gve_rx_ring *rx)
 static int gve_clean_rx_done(struct gve_rx_ring *rx, int budget,
 			     netdev_features_t feat)
 {
-	u64 xdp_redirects = rx->xdp_actions[XDP_REDIRECT];
-	u64 xdp_txs = rx->xdp_actions[XDP_TX];
 	struct gve_rx_ctx *ctx = &rx->ctx;
 	struct gve_priv *priv = rx->gve;
+	bool flow_sort = gve_get_rx_flow_sort(priv);
 	struct gve_rx_cnts cnts = {0};
 	struct gve_rx_desc *next_desc;
 	u32 idx = rx->cnt & rx->mask;
+	ktime_t batch_tstamp = 0;
 	u32 work_done = 0;
 
 	struct gve_rx_desc *desc = &rx->desc.desc_ring[idx];
@@ -917,6 +953,10 @@ static int gve_clean_rx_done(struct gve_rx_ring *rx, int budget,
 		next_desc = &rx->desc.desc_ring[(idx + 1) & rx->mask];
 		prefetch(next_desc);
 
+		if (!ctx->frag_cnt) {
+			ctx->flow_sort = flow_sort;
+			gve_rx_tstamp_start(rx, &batch_tstamp);
+		}
 		gve_rx(rx, feat, desc, idx, &cnts);
 
 		rx->cnt++;
@@ -926,33 +966,33 @@ static int gve_clean_rx_done(struct gve_rx_ring *rx, int budget,
 		work_done++;
 	}
 
+	if (rx->flow_sort.cnt)
+		gve_rx_flow_sort_flush(rx, &priv->ntfy_blocks[rx->ntfy_id].napi,
+				       &cnts);
+
 	// The device will only send whole packets.
 	if (unlikely(ctx->frag_cnt)) {
 		struct napi_struct *napi = &priv->ntfy_blocks[rx->ntfy_id].napi;
 
-		napi_free_frags(napi);
+		gve_rx_free_frags(napi, ctx);
 		gve_rx_ctx_clear(&rx->ctx);
+		gve_drop_pkt(priv->dev, rx->q_num, true, NULL, GVE_DROP_DESC_ERR);
 		netdev_warn(priv->dev, "Unexpected seq number %d with incomplete packet, expected %d, scheduling reset",
 			    GVE_SEQNO(desc->flags_seq), rx->desc.seqno);
-		gve_schedule_reset(rx->gve);
+		gve_health_report_rx_err(priv, rx->q_num,
+					 "Unexpected RX seqno");
 	}
 
 	if (!work_done && rx->fill_cnt - rx->cnt > rx->db_threshold)
 		return 0;
 
-	if (work_done) {
-		u64_stats_update_begin(&rx->statss);
-		rx->rpackets += cnts.ok_pkt_cnt;
-		rx->rbytes += cnts.ok_pkt_bytes;
-		rx->rx_cont_packet_cnt += cnts.cont_pkt_cnt;
-		rx->rx_desc_err_dropped_pkt += cnts.desc_err_pkt_cnt;
-		u64_stats_update_end(&rx->statss);
-	}
+	if (work_done)
+		gve_rx_commit_cnts(rx, &cnts);
 
-	if (xdp_txs != rx->xdp_actions[XDP_TX])
+	if (cnts.xdp_actions[XDP_TX])
 		gve_xdp_tx_flush(priv, rx->q_num);
 
-	if (xdp_redirects != rx->xdp_actions[XDP_REDIRECT])
+	if (cnts.xdp_actions[XDP_REDIRECT])
 		xdp_do_flush();
 
 	/* restock ring slots */
@@ -979,9 +1019,9 @@ static int gve_clean_rx_done(struct gve_rx_ring *rx, int budget,
 	return cnts.total_pkt_cnt;
 }
 
-int gve_rx_poll(struct gve_notify_block *block, int budget)
+int gve_rx_poll(struct gve_notify_block *block, struct gve_rx_ring *rx,
+		int budget)
 {
-	struct gve_rx_ring *rx = block->rx;
 	netdev_features_t feat;
 	int work_done = 0;
 
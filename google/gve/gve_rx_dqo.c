@@ -15,6 +15,7 @@
 #include <net/ip6_checksum.h>
 #include <net/ipv6.h>
 #include <net/tcp.h>
+#include <net/udp.h>
 
 static int gve_buf_ref_cnt(struct gve_rx_buf_state_dqo *bs)
 {
@@ -163,11 +164,94 @@ gve_get_recycled_buf_state(struct gve_rx_ring *rx)
 
 		gve_free_page_dqo(rx->gve, buf_state, true);
 		gve_free_buf_state(rx, buf_state);
+		rx->dqo.num_buf_pages--;
+		atomic64_dec(&rx->gve->rx_buf_pages);
 	}
 
 	return NULL;
 }
 
+static bool gve_rx_node_pool_get(struct gve_rx_node_pool *pool,
+				 struct page **page, dma_addr_t *addr)
+{
+	bool found = false;
+
+	spin_lock(&pool->lock);
+	if (pool->count) {
+		pool->count--;
+		*page = pool->pages[pool->count];
+		*addr = pool->page_buses[pool->count];
+		pool->borrow_cnt++;
+		found = true;
+	}
+	spin_unlock(&pool->lock);
+
+	return found;
+}
+
+static bool gve_rx_node_pool_put(struct gve_rx_node_pool *pool,
+				 struct page *page, dma_addr_t addr)
+{
+	bool stored = false;
+
+	spin_lock(&pool->lock);
+	if (pool->count < pool->size) {
+		pool->pages[pool->count] = page;
+		pool->page_buses[pool->count] = addr;
+		pool->count++;
+		pool->donate_cnt++;
+		stored = true;
+	}
+	spin_unlock(&pool->lock);
+
+	return stored;
+}
+
+/* Hand the page of an unreferenced buf_state to the node pool and release
+ * the buf_state. Returns false, leaving the buf_state untouched, if the
+ * ring does not hold surplus pages or the pool is full.
+ */
+static bool gve_rx_donate_buf_dqo(struct gve_rx_ring *rx,
+				  struct gve_rx_buf_state_dqo *buf_state)
+{
+	struct page *page = buf_state->page_info.page;
+
+	if (!rx->dqo.node_pool ||
+	    rx->dqo.num_buf_pages <= rx->dqo.bufq.mask + 1 +
+				     GVE_RX_NODE_POOL_CACHE)
+		return false;
+
+	/* Drop the bias so that the pool owns the single remaining ref */
+	page_ref_sub(page, buf_state->page_info.pagecnt_bias - 1);
+	if (!gve_rx_node_pool_put(rx->dqo.node_pool, page, buf_state->addr)) {
+		page_ref_add(page, buf_state->page_info.pagecnt_bias - 1);
+		return false;
+	}
+
+	buf_state->page_info.page = NULL;
+	buf_state->hdr_buf = NULL;
+	gve_free_buf_state(rx, buf_state);
+	rx->dqo.num_buf_pages--;
+	return true;
+}
+
+/* The ring grows by a page; @fresh if it came from the page allocator
+ * rather than the node pool, which the device total already counts.
+ */
+static void gve_rx_raise_mem_hwm_dqo(struct gve_rx_ring *rx, bool fresh)
+{
+	struct gve_priv *priv = rx->gve;
+	s64 pages;
+
+	gve_mem_hwm_raise(&rx->mem_hwm, rx->mem_fixed +
+			  (u64)rx->dqo.num_buf_pages * PAGE_SIZE);
+	if (!fresh)
+		return;
+
+	pages = atomic64_inc_return(&priv->rx_buf_pages);
+	gve_mem_hwm_raise(&priv->mem_hwm, priv->mem_fixed + pages * PAGE_SIZE);
+}
+
 static int gve_alloc_page_dqo(struct gve_rx_ring *rx,
 			      struct gve_rx_buf_state_dqo *buf_state)
 {
@@ -175,14 +259,23 @@ static int gve_alloc_page_dqo(struct gve_rx_ring *rx,
 	u32 idx;
 
 	if (!rx->dqo.qpl) {
+		bool fresh = false;
 		int err;
 
-		err = gve_alloc_page(priv, &priv->pdev->dev,
-				     &buf_state->page_info.page,
-				     &buf_state->addr,
-				     DMA_FROM_DEVICE, GFP_ATOMIC);
-		if (err)
-			return err;
+		if (!rx->dqo.node_pool ||
+		    !gve_rx_node_pool_get(rx->dqo.node_pool,
+					  &buf_state->page_info.page,
+					  &buf_state->addr)) {
+			err = gve_alloc_page(priv, &priv->pdev->dev,
+					     &buf_state->page_info.page,
+					     &buf_state->addr,
+					     DMA_FROM_DEVICE, GFP_ATOMIC);
+			if (err)
+				return err;
+			fresh = true;
+		}
+		rx->dqo.num_buf_pages++;
+		gve_rx_raise_mem_hwm_dqo(rx, fresh);
 	} else {
 		idx = rx->dqo.next_qpl_page_idx;
 		if (idx >= priv->rx_pages_per_qpl) {
@@ -324,6 +417,15 @@ static void gve_rx_init_ring_state_dqo(struct gve_rx_ring *rx,
 	/* Set RX SKB context */
 	rx->ctx.skb_head = NULL;
 	rx->ctx.skb_tail = NULL;
+	rx->dqo.udp_gro.skb = NULL;
+
+	/* No refill sampled yet; the initial fill of the empty ring is not
+	 * one, so the first interval must not report a depth of 0.
+	 */
+	rx->dqo.bufq_min_depth = U32_MAX;
+	rx->dqo.bufq_min_depth_last = rx->dqo.bufq.mask;
+	rx->dqo.bufq_depth_interval_start = jiffies;
+	rx->dqo.num_buf_pages = 0;
 
 	/* Set up linked list of buffer IDs */
 	for (i = 0; i < rx->dqo.num_buf_states - 1; i++)
@@ -463,6 +565,123 @@ static int gve_rx_alloc_hdr_buf_pool(struct gve_priv *priv)
 	return 0;
 }
 
+void gve_rx_get_mem_usage_dqo(struct gve_rx_ring *rx,
+			      struct gve_mem_usage *usage)
+{
+	u32 buffer_queue_slots = rx->dqo.bufq.mask + 1;
+	u32 completion_queue_slots = rx->dqo.complq.mask + 1;
+	u64 data = 0, pinned = 0;
+	int i;
+
+	memset(usage, 0, sizeof(*usage));
+	usage->bytes[GVE_MEM_DESC] =
+		buffer_queue_slots * sizeof(rx->dqo.bufq.desc_ring[0]) +
+		completion_queue_slots * sizeof(rx->dqo.complq.desc_ring[0]) +
+		sizeof(*rx->q_resources);
+	usage->bytes[GVE_MEM_BOOKKEEPING] =
+		rx->dqo.num_buf_states * sizeof(rx->dqo.buf_states[0]);
+
+	if (rx->dqo.qpl)
+		data = (u64)rx->dqo.qpl->num_entries * PAGE_SIZE;
+	if (rx->dqo.hdr_bufs) {
+		usage->bytes[GVE_MEM_BOOKKEEPING] +=
+			buffer_queue_slots * sizeof(rx->dqo.hdr_bufs[0]);
+		data += (u64)buffer_queue_slots * rx->gve->header_buf_size;
+	}
+
+	for (i = 0; i < rx->dqo.num_buf_states; i++) {
+		struct gve_rx_buf_state_dqo *bs = &rx->dqo.buf_states[i];
+
+		if (!bs->page_info.page)
+			continue;
+		if (!rx->dqo.qpl)
+			data += PAGE_SIZE;
+		if (gve_buf_ref_cnt(bs) > 0)
+			pinned += PAGE_SIZE;
+	}
+	usage->bytes[GVE_MEM_DATA] = data;
+	usage->bytes[GVE_MEM_PINNED] = pinned;
+}
+
+static void gve_rx_free_node_pools(struct gve_priv *priv)
+{
+	struct gve_rx_node_pool *pool;
+	int node;
+	u32 i;
+
+	if (!priv->rx_node_pools)
+		return;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		pool = priv->rx_node_pools[node];
+		if (!pool)
+			continue;
+
+		for (i = 0; i < pool->count; i++)
+			gve_free_page(&priv->pdev->dev, pool->pages[i],
+				      pool->page_buses[i], DMA_FROM_DEVICE);
+		kvfree(pool->pages);
+		kvfree(pool->page_buses);
+		kfree(pool);
+	}
+	kfree(priv->rx_node_pools);
+	priv->rx_node_pools = NULL;
+}
+
+/* Create one pool per NUMA node that has rx rings on it, sized to hold a
+ * buffer queue's worth of pages for each of those rings.
+ */
+static int gve_rx_alloc_node_pools(struct gve_priv *priv)
+{
+	struct gve_rx_node_pool *pool;
+	int node;
+	int i;
+
+	priv->rx_node_pools = kcalloc(nr_node_ids,
+				      sizeof(*priv->rx_node_pools), GFP_KERNEL);
+	if (!priv->rx_node_pools)
+		return -ENOMEM;
+
+	for (i = 0; i < priv->rx_cfg.num_queues; i++) {
+		node = priv->ntfy_blocks[gve_rx_idx_to_ntfy(priv, i)].node;
+		if (node == NUMA_NO_NODE)
+			node = 0;
+
+		pool = priv->rx_node_pools[node];
+		if (!pool) {
+			pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, node);
+			if (!pool)
+				goto err;
+			spin_lock_init(&pool->lock);
+			priv->rx_node_pools[node] = pool;
+		}
+		pool->size += priv->rx_desc_cnt;
+		priv->rx[i].dqo.node_pool = pool;
+	}
+
+	for (node = 0; node < nr_node_ids; node++) {
+		pool = priv->rx_node_pools[node];
+		if (!pool)
+			continue;
+
+		pool->pages = kvcalloc(pool->size, sizeof(*pool->pages),
+				       GFP_KERNEL);
+		pool->page_buses = kvcalloc(pool->size,
+					    sizeof(*pool->page_buses),
+					    GFP_KERNEL);
+		if (!pool->pages || !pool->page_buses)
+			goto err;
+	}
+
+	return 0;
+
+err:
+	for (i = 0; i < priv->rx_cfg.num_queues; i++)
+		priv->rx[i].dqo.node_pool = NULL;
+	gve_rx_free_node_pools(priv);
+	return -ENOMEM;
+}
+
 int gve_rx_alloc_rings_dqo(struct gve_priv *priv)
 {
 	int err = 0;
@@ -484,6 +703,17 @@ int gve_rx_alloc_rings_dqo(struct gve_priv *priv)
 		}
 	}
 
+	if (priv->rx_node_pool_enabled &&
+	    priv->queue_format == GVE_DQO_RDA_FORMAT) {
+		err = gve_rx_alloc_node_pools(priv);
+		if (err) {
+			netif_err(priv, drv, priv->dev,
+				  "Failed to alloc rx node pools: err=%d\n",
+				  err);
+			goto err;
+		}
+	}
+
 	return 0;
 
 err:
@@ -508,10 +738,79 @@ void gve_rx_free_rings_dqo(struct gve_priv *priv)
 	for (i = 0; i < priv->rx_cfg.num_queues; i++)
 		gve_rx_free_ring_dqo(priv, i);
 
+	gve_rx_free_node_pools(priv);
+
 	dma_pool_destroy(priv->header_buf_pool);
 	priv->header_buf_pool = NULL;
 }
 
+/* Track the lowest buffer queue depth seen before each refill from the
+ * poll, published once per GVE_RX_BUFQ_DEPTH_INTERVAL for ethtool.
+ */
+static void gve_rx_track_bufq_depth(struct gve_rx_ring *rx)
+{
+	const struct gve_rx_buf_queue_dqo *bufq = &rx->dqo.bufq;
+	u32 depth = (bufq->tail - bufq->head) & bufq->mask;
+
+	if (depth < rx->dqo.bufq_min_depth)
+		rx->dqo.bufq_min_depth = depth;
+
+	if (time_after(jiffies, rx->dqo.bufq_depth_interval_start +
+				GVE_RX_BUFQ_DEPTH_INTERVAL)) {
+		WRITE_ONCE(rx->dqo.bufq_min_depth_last,
+			   rx->dqo.bufq_min_depth);
+		rx->dqo.bufq_min_depth = depth;
+		rx->dqo.bufq_depth_interval_start = jiffies;
+	}
+}
+
+/* Move buffers whose pages have been released by the stack from the used
+ * list to the recycled list, so the next refill does not stall on them.
+ */
+static void gve_rx_prestage_bufs_dqo(struct gve_rx_ring *rx)
+{
+	struct gve_rx_buf_state_dqo *buf_state;
+	int i;
+
+	for (i = 0; i < GVE_RX_PRESTAGE_SCAN_DQO; i++) {
+		buf_state = gve_dequeue_buf_state(rx, &rx->dqo.used_buf_states);
+		if (!buf_state)
+			return;
+
+		if (gve_buf_ref_cnt(buf_state) == 0) {
+			rx->dqo.used_buf_states_cnt--;
+			if (!gve_rx_donate_buf_dqo(rx, buf_state))
+				gve_recycle_buf(rx, buf_state);
+		} else {
+			gve_enqueue_buf_state(rx, &rx->dqo.used_buf_states,
+					      buf_state);
+		}
+	}
+}
+
+/* Give unreferenced pages left over on the recycled list to the node pool
+ * while this ring holds more than it needs.
+ */
+static void gve_rx_donate_bufs_dqo(struct gve_rx_ring *rx)
+{
+	struct gve_rx_buf_state_dqo *buf_state;
+	int i;
+
+	for (i = 0; i < GVE_RX_PRESTAGE_SCAN_DQO; i++) {
+		buf_state = gve_dequeue_buf_state(rx,
+						  &rx->dqo.recycled_buf_states);
+		if (!buf_state)
+			return;
+
+		if (gve_buf_ref_cnt(buf_state) != 0 ||
+		    !gve_rx_donate_buf_dqo(rx, buf_state)) {
+			gve_enqueue_buf_state(rx, &rx->dqo.recycled_buf_states,
+					      buf_state);
+			return;
+		}
+	}
+}
+
 void gve_rx_post_buffers_dqo(struct gve_rx_ring *rx)
 {
 	struct gve_rx_compl_queue_dqo *complq = &rx->dqo.complq;
@@ -520,10 +819,17 @@ void gve_rx_post_buffers_dqo(struct gve_rx_ring *rx)
 	u32 num_avail_slots;
 	u32 num_full_slots;
 	u32 num_posted = 0;
+	u32 db_thresh;
 
 	num_full_slots = (bufq->tail - bufq->head) & bufq->mask;
 	num_avail_slots = bufq->mask - num_full_slots;
 
+	/* Ring the doorbell more often while the device is short of buffers,
+	 * and in bigger batches once it is comfortably stocked.
+	 */
+	db_thresh = num_full_slots < (bufq->mask + 1) / 4 ?
+		    GVE_RX_BUF_THRESH_MIN_DQO : GVE_RX_BUF_THRESH_DQO;
+
 	num_avail_slots = min_t(u32, num_avail_slots, complq->num_free_slots);
 	while (num_posted < num_avail_slots) {
 		struct gve_rx_desc_dqo *desc = &bufq->desc_ring[bufq->tail];
@@ -558,11 +864,19 @@ void gve_rx_post_buffers_dqo(struct gve_rx_ring *rx)
 		complq->num_free_slots--;
 		num_posted++;
 
-		if ((bufq->tail & (GVE_RX_BUF_THRESH_DQO - 1)) == 0)
+		if ((bufq->tail & (db_thresh - 1)) == 0)
 			gve_rx_write_doorbell_dqo(priv, rx->q_num);
 	}
 
 	rx->fill_cnt += num_posted;
+
+	/* Get ahead of the next poll if we are running out of buffers that
+	 * can be posted right away.
+	 */
+	if (rx->dqo.recycled_buf_states.head == -1)
+		gve_rx_prestage_bufs_dqo(rx);
+	else if (rx->dqo.node_pool)
+		gve_rx_donate_bufs_dqo(rx);
 }
 
 static void gve_try_recycle_buf(struct gve_priv *priv, struct gve_rx_ring *rx,
@@ -655,12 +969,13 @@ static void gve_rx_skb_hash(struct sk_buff *skb,
 	skb_set_hash(skb, le32_to_cpu(compl_desc->hash), hash_type);
 }
 
-static void gve_rx_free_skb(struct gve_rx_ring *rx)
+/* Drops the packet being assembled. The drop is traced even when no skb has
+ * been built for it yet.
+ */
+static void gve_rx_drop_skb(struct gve_rx_ring *rx,
+			    enum gve_drop_reason reason)
 {
-	if (!rx->ctx.skb_head)
-		return;
-
-	dev_kfree_skb_any(rx->ctx.skb_head);
+	gve_drop_pkt(rx->gve->dev, rx->q_num, true, rx->ctx.skb_head, reason);
 	rx->ctx.skb_head = NULL;
 	rx->ctx.skb_tail = NULL;
 }
@@ -669,6 +984,9 @@ static bool gve_rx_should_trigger_copy_ondemand(struct gve_rx_ring *rx)
 {
 	if (!rx->dqo.qpl)
 		return false;
+	/* Pages shared with the host must not reach the stack */
+	if (rx->gve->cvm_mode)
+		return true;
 	if (rx->dqo.used_buf_states_cnt <
 		     (rx->dqo.num_buf_states -
 		     GVE_DQO_QPL_ONDEMAND_ALLOC_THRESHOLD))
@@ -678,25 +996,25 @@ static bool gve_rx_should_trigger_copy_ondemand(struct gve_rx_ring *rx)
 
 static int gve_rx_copy_ondemand(struct gve_rx_ring *rx,
 				struct gve_rx_buf_state_dqo *buf_state,
-				u16 buf_len)
+				u16 buf_len, struct gve_rx_cnts *cnts)
 {
-	struct page *page = alloc_page(GFP_ATOMIC);
+	u32 offset, truesize;
+	struct page *page;
 	int num_frags;
 
+	page = gve_rx_copy_frag(buf_state->page_info.page_address +
+				buf_state->page_info.page_offset,
+				buf_len, &offset, &truesize);
 	if (!page)
 		return -ENOMEM;
 
-	memcpy(page_address(page),
-	       buf_state->page_info.page_address +
-	       buf_state->page_info.page_offset,
-	       buf_len);
 	num_frags = skb_shinfo(rx->ctx.skb_tail)->nr_frags;
 	skb_add_rx_frag(rx->ctx.skb_tail, num_frags, page,
-			0, buf_len, PAGE_SIZE);
+			offset, buf_len, truesize);
+	if (rx->ctx.skb_tail != rx->ctx.skb_head)
+		rx->ctx.skb_head->truesize += truesize;
 
-	u64_stats_update_begin(&rx->statss);
-	rx->rx_frag_alloc_cnt++;
-	u64_stats_update_end(&rx->statss);
+	cnts->frag_alloc_cnt++;
 	gve_recycle_buf(rx, buf_state);
 	return 0;
 }
@@ -707,7 +1025,7 @@ static int gve_rx_copy_ondemand(struct gve_rx_ring *rx,
 static int gve_rx_append_frags(struct napi_struct *napi,
 			       struct gve_rx_buf_state_dqo *buf_state,
 			       u16 buf_len, struct gve_rx_ring *rx,
-			       struct gve_priv *priv)
+			       struct gve_priv *priv, struct gve_rx_cnts *cnts)
 {
 	int num_frags = skb_shinfo(rx->ctx.skb_tail)->nr_frags;
 
@@ -725,12 +1043,14 @@ static int gve_rx_append_frags(struct napi_struct *napi,
 	if (rx->ctx.skb_tail != rx->ctx.skb_head) {
 		rx->ctx.skb_head->len += buf_len;
 		rx->ctx.skb_head->data_len += buf_len;
-		rx->ctx.skb_head->truesize += priv->data_buffer_size_dqo;
 	}
 
 	/* Trigger ondemand page allocation if we are running low on buffers */
 	if (gve_rx_should_trigger_copy_ondemand(rx))
-		return gve_rx_copy_ondemand(rx, buf_state, buf_len);
+		return gve_rx_copy_ondemand(rx, buf_state, buf_len, cnts);
+
+	if (rx->ctx.skb_tail != rx->ctx.skb_head)
+		rx->ctx.skb_head->truesize += priv->data_buffer_size_dqo;
 
 	skb_add_rx_frag(rx->ctx.skb_tail, num_frags,
 			buf_state->page_info.page,
@@ -745,13 +1065,92 @@ static int gve_rx_append_frags(struct napi_struct *napi,
 	return 0;
 }
 
+/* Returns the length of the Ethernet/IP/UDP headers at data if the packet is
+ * a plain, unpadded UDP datagram the driver UDP GRO stage can chain, or 0.
+ */
+static u16 gve_rx_udp_gro_hdr_len(const u8 *data, u16 hdr_avail,
+				  u32 pkt_len, u8 l3_type)
+{
+	const struct ethhdr *eth = (const struct ethhdr *)data;
+	const struct udphdr *uh;
+	u16 hlen = ETH_HLEN;
+
+	if (l3_type == GVE_L3_TYPE_IPV4) {
+		const struct iphdr *iph = (const struct iphdr *)(data + hlen);
+
+		if (hdr_avail < hlen + sizeof(*iph) + sizeof(*uh) ||
+		    eth->h_proto != htons(ETH_P_IP) || iph->ihl != 5 ||
+		    iph->protocol != IPPROTO_UDP || ip_is_fragment(iph))
+			return 0;
+		hlen += sizeof(*iph);
+	} else {
+		const struct ipv6hdr *ip6h = (const struct ipv6hdr *)(data + hlen);
+
+		if (hdr_avail < hlen + sizeof(*ip6h) + sizeof(*uh) ||
+		    eth->h_proto != htons(ETH_P_IPV6) ||
+		    ip6h->nexthdr != IPPROTO_UDP)
+			return 0;
+		hlen += sizeof(*ip6h);
+	}
+
+	/* Ethernet padding would end up in the middle of the aggregate */
+	uh = (const struct udphdr *)(data + hlen);
+	if (ntohs(uh->len) != pkt_len - hlen)
+		return 0;
+
+	return hlen + sizeof(*uh);
+}
+
+static bool gve_rx_udp_gro_candidate(struct gve_rx_ring *rx,
+				     const struct gve_rx_compl_desc_dqo *desc,
+				     struct gve_ptype ptype)
+{
+	return gve_get_udp_gro(rx->gve) && !desc->rsc &&
+	       ptype.l4_type == GVE_L4_TYPE_UDP &&
+	       (ptype.l3_type == GVE_L3_TYPE_IPV4 ||
+		ptype.l3_type == GVE_L3_TYPE_IPV6);
+}
+
+/* Build the skb for a single-buffer UDP datagram with only the headers in the
+ * linear area, so its payload frag can later be moved into an aggregate.
+ */
+static int gve_rx_udp_gro_build(struct napi_struct *napi,
+				struct gve_rx_ring *rx,
+				struct gve_rx_buf_state_dqo *buf_state,
+				u16 buf_len, u8 l3_type)
+{
+	u8 *va = buf_state->page_info.page_address +
+		 buf_state->page_info.page_offset;
+	struct gve_priv *priv = rx->gve;
+	struct sk_buff *skb;
+	u16 hdr_len;
+
+	hdr_len = gve_rx_udp_gro_hdr_len(va, buf_len, buf_len, l3_type);
+	if (!hdr_len || hdr_len == buf_len)
+		return -EINVAL;
+
+	skb = gve_rx_copy_data(priv->dev, napi, va, hdr_len);
+	if (unlikely(!skb))
+		return -ENOMEM;
+
+	skb_add_rx_frag(skb, 0, buf_state->page_info.page,
+			buf_state->page_info.page_offset + hdr_len,
+			buf_len - hdr_len, priv->data_buffer_size_dqo);
+	gve_dec_pagecnt_bias(&buf_state->page_info);
+	gve_try_recycle_buf(priv, rx, buf_state);
+
+	rx->ctx.skb_head = skb;
+	rx->ctx.skb_tail = skb;
+	return 0;
+}
+
 /* Returns 0 if descriptor is completed successfully.
  * Returns -EINVAL if descriptor is invalid.
  * Returns -ENOMEM if data cannot be copied to skb.
  */
 static int gve_rx_dqo(struct napi_struct *napi, struct gve_rx_ring *rx,
 		      const struct gve_rx_compl_desc_dqo *compl_desc,
-		      int queue_idx)
+		      int queue_idx, struct gve_rx_cnts *cnts)
 {
 	const u16 buffer_id = le16_to_cpu(compl_desc->buf_id);
 	const bool hbo = compl_desc->header_buffer_overflow != 0;
@@ -765,13 +1164,13 @@ static int gve_rx_dqo(struct napi_struct *napi, struct gve_rx_ring *rx,
 	if (unlikely(buffer_id >= rx->dqo.num_buf_states)) {
 		net_err_ratelimited("%s: Invalid RX buffer_id=%u\n",
 				    priv->dev->name, buffer_id);
-		return -EINVAL;
+		return -ENOENT;
 	}
 	buf_state = &rx->dqo.buf_states[buffer_id];
 	if (unlikely(!gve_buf_state_is_allocated(rx, buf_state))) {
 		net_err_ratelimited("%s: RX buffer_id is not allocated: %u\n",
 				    priv->dev->name, buffer_id);
-		return -EINVAL;
+		return -ENOENT;
 	}
 
 	if (unlikely(compl_desc->rx_error)) {
@@ -818,11 +1217,9 @@ static int gve_rx_dqo(struct napi_struct *napi, struct gve_rx_ring *rx,
 
 		rx->ctx.skb_tail = rx->ctx.skb_head;
 
-		u64_stats_update_begin(&rx->statss);
-		rx->rx_hsplit_pkt++;
-		rx->rx_hsplit_hbo_pkt += hbo;
-		rx->rheader_bytes += hdr_len;
-		u64_stats_update_end(&rx->statss);
+		cnts->hsplit_pkt_cnt++;
+		cnts->hsplit_hbo_pkt_cnt += hbo;
+		cnts->header_bytes += hdr_len;
 	}
 
 	/* Sync the portion of dma buffer for CPU to read. */
@@ -833,7 +1230,7 @@ static int gve_rx_dqo(struct napi_struct *napi, struct gve_rx_ring *rx,
 	/* Append to current skb if one exists. */
 	if (rx->ctx.skb_head) {
 		if (unlikely(gve_rx_append_frags(napi, buf_state, buf_len, rx,
-						 priv)) != 0)
+						 priv, cnts)) != 0)
 			goto error;
 		return 0;
 	}
@@ -845,22 +1242,30 @@ static int gve_rx_dqo(struct napi_struct *napi, struct gve_rx_ring *rx,
 			goto error;
 		rx->ctx.skb_tail = rx->ctx.skb_head;
 
-		u64_stats_update_begin(&rx->statss);
-		rx->rx_copied_pkt++;
-		rx->rx_copybreak_pkt++;
-		u64_stats_update_end(&rx->statss);
+		cnts->copied_pkt_cnt++;
+		cnts->copybreak_pkt_cnt++;
 
 		gve_recycle_buf(rx, buf_state);
 		return 0;
 	}
 
-	rx->ctx.skb_head = napi_get_frags(napi);
+	if (eop && !gve_rx_should_trigger_copy_ondemand(rx)) {
+		struct gve_ptype ptype =
+			priv->ptype_lut_dqo->ptypes[compl_desc->packet_type];
+
+		if (gve_rx_udp_gro_candidate(rx, compl_desc, ptype) &&
+		    !gve_rx_udp_gro_build(napi, rx, buf_state, buf_len,
+					  ptype.l3_type))
+			return 0;
+	}
+
+	rx->ctx.skb_head = gve_rx_get_frags(napi, rx->ctx.flow_sort);
 	if (unlikely(!rx->ctx.skb_head))
 		goto error;
 	rx->ctx.skb_tail = rx->ctx.skb_head;
 
 	if (gve_rx_should_trigger_copy_ondemand(rx)) {
-		if (gve_rx_copy_ondemand(rx, buf_state, buf_len) < 0)
+		if (gve_rx_copy_ondemand(rx, buf_state, buf_len, cnts) < 0)
 			goto error;
 		return 0;
 	}
@@ -880,23 +1285,96 @@ error:
 	return -ENOMEM;
 }
 
+/* Mark a UDP aggregate whose IP and UDP lengths already cover all of it as
+ * GSO, with the checksum left for segmentation to fill in per datagram, the
+ * way the stack's own UDP GRO completes one. Headers are in the linear area
+ * past eth_type_trans(), or still at the start of frag 0 for a skb from
+ * napi_get_frags().
+ */
+static int gve_rx_udp_gso_finish(struct sk_buff *skb, u8 l3_type,
+				 u16 gso_size)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	unsigned int nh_off = skb_headroom(skb);
+	unsigned int len = skb->len;
+	unsigned int hdr_avail;
+	unsigned int l3_len;
+	struct udphdr *uh;
+	u8 *nh;
+
+	if (!gso_size)
+		return -EINVAL;
+
+	if (skb_headlen(skb)) {
+		nh = skb->data;
+		hdr_avail = skb_headlen(skb);
+	} else {
+		const skb_frag_t *frag = &shinfo->frags[0];
+
+		if (!shinfo->nr_frags || skb_frag_size(frag) <= ETH_HLEN)
+			return -EINVAL;
+		nh = (u8 *)skb_frag_address(frag) + ETH_HLEN;
+		hdr_avail = skb_frag_size(frag) - ETH_HLEN;
+		nh_off += ETH_HLEN;
+		len -= ETH_HLEN;
+	}
+
+	if (l3_type == GVE_L3_TYPE_IPV4) {
+		struct iphdr *iph = (struct iphdr *)nh;
+
+		if (hdr_avail < sizeof(*iph))
+			return -EINVAL;
+		l3_len = iph->ihl * 4;
+		if (iph->protocol != IPPROTO_UDP || l3_len < sizeof(*iph) ||
+		    hdr_avail < l3_len + sizeof(*uh))
+			return -EINVAL;
+		uh = (struct udphdr *)(nh + l3_len);
+		if (uh->check)
+			uh->check = ~udp_v4_check(ntohs(uh->len), iph->saddr,
+						  iph->daddr, 0);
+	} else {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)nh;
+
+		l3_len = sizeof(*ip6h);
+		if (hdr_avail < l3_len + sizeof(*uh) ||
+		    ip6h->nexthdr != IPPROTO_UDP)
+			return -EINVAL;
+		uh = (struct udphdr *)(nh + l3_len);
+		if (uh->check)
+			uh->check = ~udp_v6_check(ntohs(uh->len), &ip6h->saddr,
+						  &ip6h->daddr, 0);
+	}
+
+	skb->csum_start = nh_off + l3_len;
+	skb->csum_offset = offsetof(struct udphdr, check);
+	skb->ip_summed = CHECKSUM_PARTIAL;
+	shinfo->gso_type = SKB_GSO_UDP_L4;
+	shinfo->gso_size = gso_size;
+	shinfo->gso_segs = DIV_ROUND_UP(len - l3_len - sizeof(*uh), gso_size);
+	return 0;
+}
+
 static int gve_rx_complete_rsc(struct sk_buff *skb,
 			       const struct gve_rx_compl_desc_dqo *desc,
 			       struct gve_ptype ptype)
 {
 	struct skb_shared_info *shinfo = skb_shinfo(skb);
 
-	/* Only TCP is supported right now. */
-	if (ptype.l4_type != GVE_L4_TYPE_TCP)
+	if (ptype.l3_type != GVE_L3_TYPE_IPV4 &&
+	    ptype.l3_type != GVE_L3_TYPE_IPV6)
 		return -EINVAL;
 
-	switch (ptype.l3_type) {
-	case GVE_L3_TYPE_IPV4:
-		shinfo->gso_type = SKB_GSO_TCPV4;
-		break;
-	case GVE_L3_TYPE_IPV6:
-		shinfo->gso_type = SKB_GSO_TCPV6;
+	switch (ptype.l4_type) {
+	case GVE_L4_TYPE_TCP:
+		shinfo->gso_type = ptype.l3_type == GVE_L3_TYPE_IPV4 ?
+				   SKB_GSO_TCPV4 : SKB_GSO_TCPV6;
 		break;
+	case GVE_L4_TYPE_UDP:
+		/* Like TCP RSC, the device rewrites the IP and UDP lengths
+		 * to cover the whole aggregate.
+		 */
+		return gve_rx_udp_gso_finish(skb, ptype.l3_type,
+					     le16_to_cpu(desc->rsc_seg_len));
 	default:
 		return -EINVAL;
 	}
@@ -905,16 +1383,164 @@ static int gve_rx_complete_rsc(struct sk_buff *skb,
 	return 0;
 }
 
+/* Fix up the headers of a multi-datagram aggregate and mark it GSO so the
+ * stack can deliver it to UDP_GRO sockets whole or segment it otherwise.
+ */
+static void gve_rx_udp_gro_finish(struct gve_rx_udp_gro *gro)
+{
+	struct sk_buff *skb = gro->skb;
+	struct udphdr *uh;
+
+	if (gro->l3_type == GVE_L3_TYPE_IPV4) {
+		struct iphdr *iph = (struct iphdr *)skb->data;
+
+		iph->tot_len = htons(skb->len);
+		iph->check = 0;
+		iph->check = ip_fast_csum((u8 *)iph, iph->ihl);
+		uh = (struct udphdr *)(iph + 1);
+		uh->len = htons(skb->len - sizeof(*iph));
+	} else {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)skb->data;
+
+		ip6h->payload_len = htons(skb->len - sizeof(*ip6h));
+		uh = (struct udphdr *)(ip6h + 1);
+		uh->len = ip6h->payload_len;
+	}
+
+	/* Only plain UDP headers get this far, so this cannot fail */
+	gve_rx_udp_gso_finish(skb, gro->l3_type, gro->seg_len);
+}
+
+static void gve_rx_udp_gro_flush(struct gve_rx_ring *rx,
+				 struct napi_struct *napi,
+				 struct gve_rx_cnts *cnts)
+{
+	struct gve_rx_udp_gro *gro = &rx->dqo.udp_gro;
+
+	if (!gro->skb)
+		return;
+
+	if (gro->segs > 1)
+		gve_rx_udp_gro_finish(gro);
+	gve_rx_gro(rx, napi, gro->skb, gve_get_rx_flow_sort(rx->gve), cnts);
+	gro->skb = NULL;
+}
+
+static bool gve_rx_udp_gro_match(const struct gve_rx_udp_gro *gro,
+				 const struct sk_buff *skb, u32 hash,
+				 u8 l3_type)
+{
+	const struct sk_buff *agg = gro->skb;
+	const struct udphdr *uh, *agg_uh;
+
+	if (gro->closed || gro->hash != hash || gro->l3_type != l3_type ||
+	    gro->segs >= GVE_UDP_GRO_MAX_SEGS ||
+	    skb_headlen(skb) != skb_headlen(agg) ||
+	    skb->data_len > gro->seg_len ||
+	    agg->len + skb->data_len > GVE_UDP_GRO_MAX_LEN ||
+	    skb_shinfo(agg)->nr_frags + skb_shinfo(skb)->nr_frags >
+	    MAX_SKB_FRAGS)
+		return false;
+
+	if (l3_type == GVE_L3_TYPE_IPV4) {
+		const struct iphdr *iph = (const struct iphdr *)skb->data;
+		const struct iphdr *agg_iph = (const struct iphdr *)agg->data;
+
+		if (iph->saddr != agg_iph->saddr ||
+		    iph->daddr != agg_iph->daddr ||
+		    iph->tos != agg_iph->tos || iph->ttl != agg_iph->ttl ||
+		    ((iph->frag_off ^ agg_iph->frag_off) & htons(IP_DF)))
+			return false;
+		uh = (const struct udphdr *)(iph + 1);
+		agg_uh = (const struct udphdr *)(agg_iph + 1);
+	} else {
+		const struct ipv6hdr *ip6h = (const struct ipv6hdr *)skb->data;
+		const struct ipv6hdr *agg_ip6h =
+			(const struct ipv6hdr *)agg->data;
+
+		if (ipv6_addr_cmp(&ip6h->saddr, &agg_ip6h->saddr) ||
+		    ipv6_addr_cmp(&ip6h->daddr, &agg_ip6h->daddr) ||
+		    ((*(__be32 *)ip6h ^ *(__be32 *)agg_ip6h) &
+		     IPV6_FLOWINFO_MASK) ||
+		    ip6h->hop_limit != agg_ip6h->hop_limit)
+			return false;
+		uh = (const struct udphdr *)(ip6h + 1);
+		agg_uh = (const struct udphdr *)(agg_ip6h + 1);
+	}
+
+	return uh->source == agg_uh->source && uh->dest == agg_uh->dest &&
+	       !uh->check == !agg_uh->check;
+}
+
+/* Driver-side UDP GRO stage keyed on RSS hash and ptype. Returns true if the
+ * skb was consumed: either held as the start of a new aggregate or merged
+ * into the current one.
+ */
+static bool gve_rx_udp_gro(struct gve_rx_ring *rx, struct napi_struct *napi,
+			   struct sk_buff *skb, u32 hash, u8 l3_type,
+			   struct gve_rx_cnts *cnts)
+{
+	struct gve_rx_udp_gro *gro = &rx->dqo.udp_gro;
+	struct skb_shared_info *dst, *src;
+	u32 payload = skb->data_len;
+	int i;
+
+	/* Only skbs built by gve_rx_udp_gro_build() or header split, with
+	 * exactly the headers in the linear area and a verified checksum.
+	 */
+	if (!payload || skb->ip_summed != CHECKSUM_UNNECESSARY ||
+	    gve_rx_udp_gro_hdr_len(skb_mac_header(skb),
+				   skb_headlen(skb) + ETH_HLEN,
+				   skb->len + ETH_HLEN, l3_type) !=
+	    skb_headlen(skb) + ETH_HLEN)
+		return false;
+
+	if (gro->skb && !gve_rx_udp_gro_match(gro, skb, hash, l3_type))
+		gve_rx_udp_gro_flush(rx, napi, cnts);
+
+	if (!gro->skb) {
+		gro->skb = skb;
+		gro->hash = hash;
+		gro->l3_type = l3_type;
+		gro->seg_len = payload;
+		gro->segs = 1;
+		gro->closed = false;
+		return true;
+	}
+
+	dst = skb_shinfo(gro->skb);
+	src = skb_shinfo(skb);
+	for (i = 0; i < src->nr_frags; i++)
+		dst->frags[dst->nr_frags++] = src->frags[i];
+	gro->skb->len += payload;
+	gro->skb->data_len += payload;
+	gro->skb->truesize += src->nr_frags * rx->gve->data_buffer_size_dqo;
+
+	/* The page references now belong to the aggregate */
+	skb->truesize -= src->nr_frags * rx->gve->data_buffer_size_dqo;
+	src->nr_frags = 0;
+	skb->len -= payload;
+	skb->data_len = 0;
+	napi_consume_skb(skb, 1);
+
+	if (payload < gro->seg_len)
+		gro->closed = true;
+	gro->segs++;
+	cnts->udp_gro_pkt_cnt++;
+	return true;
+}
+
 /* Returns 0 if skb is completed successfully, -1 otherwise. */
 static int gve_rx_complete_skb(struct gve_rx_ring *rx, struct napi_struct *napi,
 			       const struct gve_rx_compl_desc_dqo *desc,
-			       netdev_features_t feat)
+			       netdev_features_t feat, struct gve_rx_cnts *cnts)
 {
 	struct gve_ptype ptype =
 		rx->gve->ptype_lut_dqo->ptypes[desc->packet_type];
 	int err;
 
 	skb_record_rx_queue(rx->ctx.skb_head, rx->q_num);
+	gve_rx_tstamp_skb(rx, rx->ctx.skb_head);
 
 	if (feat & NETIF_F_RXHASH)
 		gve_rx_skb_hash(rx->ctx.skb_head, desc, ptype);
@@ -931,24 +1557,32 @@ static int gve_rx_complete_skb(struct gve_rx_ring *rx, struct napi_struct *napi,
 			return err;
 	}
 
-	if (skb_headlen(rx->ctx.skb_head) == 0)
-		napi_gro_frags(napi);
-	else
-		napi_gro_receive(napi, rx->ctx.skb_head);
+	if (skb_headlen(rx->ctx.skb_head) &&
+	    gve_rx_udp_gro_candidate(rx, desc, ptype) &&
+	    gve_rx_udp_gro(rx, napi, rx->ctx.skb_head, le32_to_cpu(desc->hash),
+			   ptype.l3_type, cnts))
+		return 0;
+
+	/* Anything held by the UDP GRO stage goes up first to keep order */
+	gve_rx_udp_gro_flush(rx, napi, cnts);
+
+	gve_rx_gro(rx, napi, rx->ctx.skb_head, rx->ctx.flow_sort, cnts);
 
 	return 0;
 }
 
-int gve_rx_poll_dqo(struct gve_notify_block *block, int budget)
+int gve_rx_poll_dqo(struct gve_notify_block *block, struct gve_rx_ring *rx,
+		    int budget)
 {
 	struct napi_struct *napi = &block->napi;
 	netdev_features_t feat = napi->dev->features;
 
-	struct gve_rx_ring *rx = block->rx;
 	struct gve_rx_compl_queue_dqo *complq = &rx->dqo.complq;
 
+	bool flow_sort = gve_get_rx_flow_sort(rx->gve);
+	struct gve_rx_cnts cnts = {0};
+	ktime_t batch_tstamp = 0;
 	u32 work_done = 0;
-	u64 bytes = 0;
 	int err;
 
 	while (work_done < budget) {
@@ -967,17 +1601,27 @@ int gve_rx_poll_dqo(struct gve_notify_block *block, int budget)
 		/* Do not read data until we own the descriptor */
 		dma_rmb();
 
-		err = gve_rx_dqo(napi, rx, compl_desc, rx->q_num);
+		if (!rx->ctx.skb_head) {
+			rx->ctx.flow_sort = flow_sort;
+			gve_rx_tstamp_start(rx, &batch_tstamp);
+		}
+		err = gve_rx_dqo(napi, rx, compl_desc, rx->q_num, &cnts);
 		if (err < 0) {
-			gve_rx_free_skb(rx);
-			u64_stats_update_begin(&rx->statss);
-			if (err == -ENOMEM)
-				rx->rx_skb_alloc_fail++;
-			else if (err == -EINVAL)
-				rx->rx_desc_err_dropped_pkt++;
-			else if (err == -EFAULT)
-				rx->rx_hsplit_err_dropped_pkt++;
-			u64_stats_update_end(&rx->statss);
+			enum gve_drop_reason reason = GVE_DROP_DESC_ERR;
+
+			if (err == -ENOMEM) {
+				cnts.skb_alloc_fail_cnt++;
+				reason = GVE_DROP_ALLOC_FAIL;
+			} else if (err == -EINVAL) {
+				cnts.desc_err_pkt_cnt++;
+			} else if (err == -ENOENT) {
+				cnts.desc_err_pkt_cnt++;
+				reason = GVE_DROP_BAD_BUF_ID;
+			} else if (err == -EFAULT) {
+				cnts.hsplit_err_pkt_cnt++;
+				reason = GVE_DROP_HSPLIT_OVERFLOW;
+			}
+			gve_rx_drop_skb(rx, reason);
 		}
 
 		complq->head = (complq->head + 1) & complq->mask;
@@ -998,6 +1642,11 @@ int gve_rx_poll_dqo(struct gve_notify_block *block, int budget)
 		/* Free running counter of completed descriptors */
 		rx->cnt++;
 
+		if ((rx->cnt & (GVE_RX_POST_INTERVAL_DQO - 1)) == 0) {
+			gve_rx_track_bufq_depth(rx);
+			gve_rx_post_buffers_dqo(rx);
+		}
+
 		if (!rx->ctx.skb_head)
 			continue;
 
@@ -1005,6 +1654,7 @@ int gve_rx_poll_dqo(struct gve_notify_block *block, int budget)
 			continue;
 
 		work_done++;
+		cnts.ok_pkt_cnt++;
 		pkt_bytes = rx->ctx.skb_head->len;
 		/* The ethernet header (first ETH_HLEN bytes) is snipped off
 		 * by eth_type_trans.
@@ -1013,25 +1663,26 @@ int gve_rx_poll_dqo(struct gve_notify_block *block, int budget)
 			pkt_bytes += ETH_HLEN;
 
 		/* gve_rx_complete_skb() will consume skb if successful */
-		if (gve_rx_complete_skb(rx, napi, compl_desc, feat) != 0) {
-			gve_rx_free_skb(rx);
-			u64_stats_update_begin(&rx->statss);
-			rx->rx_desc_err_dropped_pkt++;
-			u64_stats_update_end(&rx->statss);
+		if (gve_rx_complete_skb(rx, napi, compl_desc, feat,
+					&cnts) != 0) {
+			gve_rx_drop_skb(rx, GVE_DROP_DESC_ERR);
+			cnts.desc_err_pkt_cnt++;
 			continue;
 		}
 
-		bytes += pkt_bytes;
+		cnts.ok_pkt_bytes += pkt_bytes;
 		rx->ctx.skb_head = NULL;
 		rx->ctx.skb_tail = NULL;
 	}
 
+	gve_rx_udp_gro_flush(rx, napi, &cnts);
+	if (rx->flow_sort.cnt)
+		gve_rx_flow_sort_flush(rx, napi, &cnts);
+	gve_rx_track_bufq_depth(rx);
 	gve_rx_post_buffers_dqo(rx);
 
-	u64_stats_update_begin(&rx->statss);
-	rx->rpackets += work_done;
-	rx->rbytes += bytes;
-	u64_stats_update_end(&rx->statss);
+	/* rpackets also counts packets dropped by gve_rx_complete_skb() */
+	gve_rx_commit_cnts(rx, &cnts);
 
 	return work_done;
 }
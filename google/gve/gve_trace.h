@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: (GPL-2.0 OR MIT)
+ * Google virtual Ethernet (gve) driver
+ *
+ * Copyright (C) 2015-2024 Google, Inc.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM gve
+
+#if !defined(_GVE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _GVE_TRACE_H
+
+#include <linux/netdevice.h>
+#include <linux/tracepoint.h>
+
+#include "gve.h"
+
+TRACE_DEFINE_ENUM(GVE_DROP_LINEARIZE);
+TRACE_DEFINE_ENUM(GVE_DROP_BAD_GSO);
+TRACE_DEFINE_ENUM(GVE_DROP_DMA_MAP);
+TRACE_DEFINE_ENUM(GVE_DROP_DESC_ERR);
+TRACE_DEFINE_ENUM(GVE_DROP_HSPLIT_OVERFLOW);
+TRACE_DEFINE_ENUM(GVE_DROP_ALLOC_FAIL);
+TRACE_DEFINE_ENUM(GVE_DROP_BAD_BUF_ID);
+TRACE_DEFINE_ENUM(GVE_DROP_COMPL_TIMEOUT);
+
+#define gve_show_drop_reason(reason)					\
+	__print_symbolic(reason,					\
+			 { GVE_DROP_LINEARIZE,		"linearize" },	\
+			 { GVE_DROP_BAD_GSO,		"bad_gso" },	\
+			 { GVE_DROP_DMA_MAP,		"dma_map" },	\
+			 { GVE_DROP_DESC_ERR,		"desc_err" },	\
+			 { GVE_DROP_HSPLIT_OVERFLOW,	"hsplit_overflow" }, \
+			 { GVE_DROP_ALLOC_FAIL,		"alloc_fail" },	\
+			 { GVE_DROP_BAD_BUF_ID,		"bad_buf_id" },	\
+			 { GVE_DROP_COMPL_TIMEOUT,	"compl_timeout" })
+
+/* Fired at every point where gve discards a packet, whether or not an skb
+ * has been built for it yet.
+ */
+TRACE_EVENT(gve_drop,
+	TP_PROTO(const struct net_device *dev, u32 queue, bool rx,
+		 const void *skbaddr, enum gve_drop_reason reason),
+
+	TP_ARGS(dev, queue, rx, skbaddr, reason),
+
+	TP_STRUCT__entry(
+		__array(char, name, IFNAMSIZ)
+		__field(u32, queue)
+		__field(bool, rx)
+		__field(const void *, skbaddr)
+		__field(u8, reason)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->name, dev->name, IFNAMSIZ);
+		__entry->queue = queue;
+		__entry->rx = rx;
+		__entry->skbaddr = skbaddr;
+		__entry->reason = reason;
+	),
+
+	TP_printk("dev=%s %s queue=%u skbaddr=%p reason=%s",
+		  __entry->name, __entry->rx ? "rx" : "tx", __entry->queue,
+		  __entry->skbaddr, gve_show_drop_reason(__entry->reason))
+);
+
+#endif /* _GVE_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE gve_trace
+#include <trace/define_trace.h>
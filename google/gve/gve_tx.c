@@ -155,7 +155,7 @@ static size_t gve_tx_clear_buffer_state(struct gve_tx_buffer_state *info)
 }
 
 static int gve_clean_xdp_done(struct gve_priv *priv, struct gve_tx_ring *tx,
-			      u32 to_do)
+			      u32 to_do, struct gve_tx_cnts *cnts)
 {
 	struct gve_tx_buffer_state *info;
 	u32 clean_end = tx->done + to_do;
@@ -186,10 +186,8 @@ static int gve_clean_xdp_done(struct gve_priv *priv, struct gve_tx_ring *tx,
 	gve_tx_free_fifo(&tx->tx_fifo, space_freed);
 	if (xsk_complete > 0 && tx->xsk_pool)
 		xsk_tx_completed(tx->xsk_pool, xsk_complete);
-	u64_stats_update_begin(&tx->statss);
-	tx->bytes_done += bytes;
-	tx->pkt_done += pkts;
-	u64_stats_update_end(&tx->statss);
+	cnts->bytes_done += bytes;
+	cnts->pkt_done += pkts;
 	return pkts;
 }
 
@@ -209,7 +207,10 @@ static void gve_tx_free_ring(struct gve_priv *priv, int idx)
 		gve_clean_tx_done(priv, tx, priv->tx_desc_cnt, false);
 		netdev_tx_reset_queue(tx->netdev_txq);
 	} else {
-		gve_clean_xdp_done(priv, tx, priv->tx_desc_cnt);
+		struct gve_tx_cnts cnts = {0};
+
+		gve_clean_xdp_done(priv, tx, priv->tx_desc_cnt, &cnts);
+		gve_tx_commit_cnts(tx, &cnts);
 	}
 
 	dma_free_coherent(hdev, sizeof(*tx->q_resources),
@@ -226,6 +227,7 @@ static void gve_tx_free_ring(struct gve_priv *priv, int idx)
 	dma_free_coherent(hdev, bytes, tx->desc, tx->bus);
 	tx->desc = NULL;
 
+	gve_tx_free_sgl(tx);
 	vfree(tx->info);
 	tx->info = NULL;
 
@@ -260,6 +262,8 @@ static int gve_tx_alloc_ring(struct gve_priv *priv, int idx)
 
 	tx->raw_addressing = priv->queue_format == GVE_GQI_RDA_FORMAT;
 	tx->dev = &priv->pdev->dev;
+	if (tx->raw_addressing && gve_tx_alloc_sgl(priv, tx, slots))
+		goto abort_with_desc;
 	if (!tx->raw_addressing) {
 		tx->tx_fifo.qpl = gve_assign_tx_qpl(priv, idx);
 		if (!tx->tx_fifo.qpl)
@@ -291,6 +295,7 @@ abort_with_fifo:
 abort_with_qpl:
 	if (!tx->raw_addressing)
 		gve_unassign_qpl(priv, tx->tx_fifo.qpl->id);
+	gve_tx_free_sgl(tx);
 abort_with_desc:
 	dma_free_coherent(hdev, bytes, tx->desc, tx->bus);
 	tx->desc = NULL;
@@ -300,6 +305,22 @@ abort_with_info:
 	return -ENOMEM;
 }
 
+void gve_tx_get_mem_usage(struct gve_tx_ring *tx, struct gve_mem_usage *usage)
+{
+	u32 slots = tx->mask + 1;
+
+	memset(usage, 0, sizeof(*usage));
+	usage->bytes[GVE_MEM_DESC] = slots * sizeof(*tx->desc) +
+				     sizeof(*tx->q_resources);
+	usage->bytes[GVE_MEM_BOOKKEEPING] = slots * sizeof(*tx->info);
+	if (tx->sgl)
+		usage->bytes[GVE_MEM_BOOKKEEPING] +=
+			(u64)slots * GVE_TX_SG_MAX_ENTS * sizeof(*tx->sgl);
+	if (!tx->raw_addressing)
+		usage->bytes[GVE_MEM_DATA] =
+			(u64)tx->tx_fifo.qpl->num_entries * PAGE_SIZE;
+}
+
 int gve_tx_alloc_rings(struct gve_priv *priv, int start_id, int num_rings)
 {
 	int err = 0;
@@ -371,14 +392,23 @@ static inline int gve_skb_fifo_bytes_required(struct gve_tx_ring *tx,
  * 1 for metadata descriptor
  */
 #define MAX_TX_DESC_NEEDED	(MAX_SKB_FRAGS + 4)
-static void gve_tx_unmap_buf(struct device *dev, struct gve_tx_buffer_state *info)
+static void gve_tx_unmap_buf(struct gve_tx_ring *tx,
+			     struct gve_tx_buffer_state *info)
 {
-	if (info->skb) {
+	struct device *dev = tx->dev;
+
+	if (info->sg_nents) {
+		/* The whole packet was mapped as one scatterlist */
+		dma_unmap_sg(dev, &tx->sgl[(info - tx->info) * GVE_TX_SG_MAX_ENTS],
+			     info->sg_nents, DMA_TO_DEVICE);
+		info->sg_nents = 0;
+		dma_unmap_len_set(info, len, 0);
+	} else if (info->skb) {
 		dma_unmap_single(dev, dma_unmap_addr(info, dma),
 				 dma_unmap_len(info, len),
 				 DMA_TO_DEVICE);
 		dma_unmap_len_set(info, len, 0);
-	} else {
+	} else if (dma_unmap_len(info, len)) {
 		dma_unmap_page(dev, dma_unmap_addr(info, dma),
 			       dma_unmap_len(info, len),
 			       DMA_TO_DEVICE);
@@ -418,8 +448,15 @@ static int gve_maybe_stop_tx(struct gve_priv *priv, struct gve_tx_ring *tx,
 
 	ret = -EBUSY;
 	spin_lock(&tx->clean_lock);
-	nic_done = gve_tx_load_event_counter(priv, tx);
-	to_do = nic_done - tx->done;
+	/* Completions the last poll left behind may be enough, avoid reading
+	 * the device-written counter if so.
+	 */
+	to_do = tx->nic_done_cache - tx->done;
+	if (to_do + gve_tx_avail(tx) < MAX_TX_DESC_NEEDED) {
+		nic_done = gve_tx_load_event_counter(priv, tx);
+		tx->nic_done_cache = nic_done;
+		to_do = nic_done - tx->done;
+	}
 
 	/* Only try to clean if there is hope for TX */
 	if (to_do + gve_tx_avail(tx) >= MAX_TX_DESC_NEEDED) {
@@ -432,8 +469,7 @@ static int gve_maybe_stop_tx(struct gve_priv *priv, struct gve_tx_ring *tx,
 	}
 	if (ret) {
 		/* No space, so stop the queue */
-		tx->stop_queue++;
-		netif_tx_stop_queue(tx->netdev_txq);
+		gve_tx_stop_queue(tx);
 	}
 	spin_unlock(&tx->clean_lock);
 
@@ -673,13 +709,101 @@ unmap_drop:
 		if (i == 1 && mtd_desc_nr == 1)
 			continue;
 		idx--;
-		gve_tx_unmap_buf(tx->dev, &tx->info[idx & tx->mask]);
+		gve_tx_unmap_buf(tx, &tx->info[idx & tx->mask]);
 	}
 drop:
 	tx->dropped_pkt++;
 	return 0;
 }
 
+/* Slots after the first one of a scatterlist-mapped packet own no mapping;
+ * the whole packet is unmapped through the first slot.
+ */
+static void gve_tx_clear_sg_slot(struct gve_tx_buffer_state *info)
+{
+	info->skb = NULL;
+	info->sg_nents = 0;
+	dma_unmap_len_set(info, len, 0);
+}
+
+/* Like gve_tx_add_skb_no_copy, but the head and frags are mapped with a
+ * single dma_map_sg call. The IOMMU may merge entries, so descriptors are
+ * built from the mapped entries and never outnumber the per-buffer path's.
+ */
+static int gve_tx_add_skb_sg(struct gve_priv *priv, struct gve_tx_ring *tx,
+			     struct sk_buff *skb)
+{
+	int hlen, num_descriptors, l4_hdr_offset, nents, mapped;
+	union gve_tx_desc *pkt_desc, *mtd_desc, *seg_desc;
+	struct gve_tx_buffer_state *info;
+	int mtd_desc_nr = !!skb->l4_hash;
+	bool is_gso = skb_is_gso(skb);
+	u32 idx = tx->req & tx->mask;
+	struct scatterlist *sgl, *sg;
+	u64 addr;
+	u32 len;
+	int i;
+
+	info = &tx->info[idx];
+	pkt_desc = &tx->desc[idx];
+	sgl = &tx->sgl[idx * GVE_TX_SG_MAX_ENTS];
+
+	l4_hdr_offset = skb_checksum_start_offset(skb);
+	hlen = is_gso ? l4_hdr_offset + tcp_hdrlen(skb) : skb_headlen(skb);
+
+	mapped = gve_tx_map_skb_sg(tx->dev, skb, sgl, &nents);
+	if (unlikely(!mapped)) {
+		tx->dma_mapping_error++;
+		tx->dropped_pkt++;
+		return 0;
+	}
+	info->skb = skb;
+	info->sg_nents = nents;
+
+	/* The first entry holds at least the linear portion */
+	addr = sg_dma_address(sgl);
+	len = sg_dma_len(sgl);
+
+	num_descriptors = mapped;
+	if (hlen < len)
+		num_descriptors++;
+	if (mtd_desc_nr)
+		num_descriptors++;
+
+	gve_tx_fill_pkt_desc(pkt_desc, skb->csum_offset, skb->ip_summed,
+			     is_gso, l4_hdr_offset,
+			     num_descriptors, hlen, addr, skb->len);
+
+	if (mtd_desc_nr) {
+		idx = (idx + 1) & tx->mask;
+		mtd_desc = &tx->desc[idx];
+		gve_tx_fill_mtd_desc(mtd_desc, skb);
+		gve_tx_clear_sg_slot(&tx->info[idx]);
+	}
+
+	if (hlen < len) {
+		idx = (idx + 1) & tx->mask;
+		seg_desc = &tx->desc[idx];
+		gve_tx_fill_seg_desc(seg_desc, skb_network_offset(skb),
+				     skb_shinfo(skb)->gso_size,
+				     skb_is_gso_v6(skb), is_gso,
+				     len - hlen, addr + hlen);
+		gve_tx_clear_sg_slot(&tx->info[idx]);
+	}
+
+	for_each_sg(sg_next(sgl), sg, mapped - 1, i) {
+		idx = (idx + 1) & tx->mask;
+		seg_desc = &tx->desc[idx];
+		gve_tx_fill_seg_desc(seg_desc, skb_network_offset(skb),
+				     skb_shinfo(skb)->gso_size,
+				     skb_is_gso_v6(skb), is_gso,
+				     sg_dma_len(sg), sg_dma_address(sg));
+		gve_tx_clear_sg_slot(&tx->info[idx]);
+	}
+
+	return num_descriptors;
+}
+
 netdev_tx_t gve_tx(struct sk_buff *skb, struct net_device *dev)
 {
 	struct gve_priv *priv = netdev_priv(dev);
@@ -698,7 +822,9 @@ netdev_tx_t gve_tx(struct sk_buff *skb, struct net_device *dev)
 		gve_tx_put_doorbell(priv, tx->q_resources, tx->req);
 		return NETDEV_TX_BUSY;
 	}
-	if (tx->raw_addressing)
+	if (tx->sgl)
+		nsegs = gve_tx_add_skb_sg(priv, tx, skb);
+	else if (tx->raw_addressing)
 		nsegs = gve_tx_add_skb_no_copy(priv, tx, skb);
 	else
 		nsegs = gve_tx_add_skb_copy(priv, tx, skb);
@@ -709,7 +835,8 @@ netdev_tx_t gve_tx(struct sk_buff *skb, struct net_device *dev)
 		skb_tx_timestamp(skb);
 		tx->req += nsegs;
 	} else {
-		dev_kfree_skb_any(skb);
+		/* Only the RDA and scatterlist paths can fail, on DMA mapping */
+		gve_drop_pkt(priv->dev, tx->q_num, false, skb, GVE_DROP_DMA_MAP);
 	}
 
 	if (!netif_xmit_stopped(tx->netdev_txq) && netdev_xmit_more())
@@ -821,6 +948,28 @@ int gve_xdp_xmit_one(struct gve_priv *priv, struct gve_tx_ring *tx,
 
 #define GVE_TX_START_THRESH	PAGE_SIZE
 
+/* Checks if a stopped queue has enough room to be woken, at least room for
+ * one packet. Thresholds are set by the tx_wake_thresh_gqi devlink param.
+ */
+static bool gve_tx_can_wake(struct gve_priv *priv, struct gve_tx_ring *tx)
+{
+	u32 pct = READ_ONCE(priv->tx_wake_thresh_gqi);
+	u32 descs, bytes;
+
+	descs = gve_tx_wake_thresh(tx, pct, tx->mask + 1, priv->dev->mtu);
+	if (gve_tx_avail(tx) < max_t(u32, descs, MAX_TX_DESC_NEEDED))
+		return false;
+	if (tx->raw_addressing)
+		return true;
+
+	bytes = gve_tx_wake_thresh(tx, pct, tx->tx_fifo.size, 1);
+	return gve_tx_fifo_can_alloc(&tx->tx_fifo,
+				     max_t(u32, bytes, GVE_TX_START_THRESH));
+}
+
+/* info[] entries prefetched ahead of the one being cleaned */
+#define GVE_TX_CLEAN_PREFETCH	4
+
 static int gve_clean_tx_done(struct gve_priv *priv, struct gve_tx_ring *tx,
 			     u32 to_do, bool try_to_wake)
 {
@@ -831,7 +980,14 @@ static int gve_clean_tx_done(struct gve_priv *priv, struct gve_tx_ring *tx,
 	u32 idx;
 	int j;
 
+	/* Warm up the info[] entries of the batch ahead of the loop */
+	for (j = 0; j < min_t(u32, to_do, GVE_TX_CLEAN_PREFETCH); j++)
+		prefetch(&tx->info[(tx->done + j) & tx->mask]);
+
 	for (j = 0; j < to_do; j++) {
+		if (j + GVE_TX_CLEAN_PREFETCH < to_do)
+			prefetch(&tx->info[(tx->done + GVE_TX_CLEAN_PREFETCH) &
+					   tx->mask]);
 		idx = tx->done & tx->mask;
 		netif_info(priv, tx_done, priv->dev,
 			   "[%d] %s: idx=%d (req=%u done=%u)\n",
@@ -841,7 +997,7 @@ static int gve_clean_tx_done(struct gve_priv *priv, struct gve_tx_ring *tx,
 
 		/* Unmap the buffer */
 		if (tx->raw_addressing)
-			gve_tx_unmap_buf(tx->dev, info);
+			gve_tx_unmap_buf(tx, info);
 		tx->done++;
 		/* Mark as free */
 		if (skb) {
@@ -869,8 +1025,8 @@ static int gve_clean_tx_done(struct gve_priv *priv, struct gve_tx_ring *tx,
 	smp_mb();
 #endif
 	if (try_to_wake && netif_tx_queue_stopped(tx->netdev_txq) &&
-	    likely(gve_can_tx(tx, GVE_TX_START_THRESH))) {
-		tx->wake_queue++;
+	    likely(gve_tx_can_wake(priv, tx))) {
+		gve_tx_account_wake(tx);
 		netif_tx_wake_queue(tx->netdev_txq);
 	}
 
@@ -917,10 +1073,11 @@ out:
 	return sent;
 }
 
-bool gve_xdp_poll(struct gve_notify_block *block, int budget)
+bool gve_xdp_poll(struct gve_notify_block *block, struct gve_tx_ring *tx,
+		  int budget)
 {
 	struct gve_priv *priv = block->priv;
-	struct gve_tx_ring *tx = block->tx;
+	struct gve_tx_cnts cnts = {0};
 	u32 nic_done;
 	bool repoll;
 	u32 to_do;
@@ -932,28 +1089,41 @@ bool gve_xdp_poll(struct gve_notify_block *block, int budget)
 	/* Find out how much work there is to be done */
 	nic_done = gve_tx_load_event_counter(priv, tx);
 	to_do = min_t(u32, (nic_done - tx->done), budget);
-	gve_clean_xdp_done(priv, tx, to_do);
+	gve_clean_xdp_done(priv, tx, to_do, &cnts);
 	repoll = nic_done != tx->done;
 
 	if (tx->xsk_pool) {
 		int sent = gve_xsk_tx(priv, tx, budget);
 
-		u64_stats_update_begin(&tx->statss);
-		tx->xdp_xsk_sent += sent;
-		u64_stats_update_end(&tx->statss);
+		cnts.xsk_sent += sent;
 		repoll |= (sent == budget);
 		if (xsk_uses_need_wakeup(tx->xsk_pool))
 			xsk_set_tx_need_wakeup(tx->xsk_pool);
 	}
+	gve_tx_commit_cnts(tx, &cnts);
 
 	/* If we still have work we want to repoll */
 	return repoll;
 }
 
-bool gve_tx_poll(struct gve_notify_block *block, int budget)
+/* Completion-threshold mode: fewer than tx_compl_thresh_gqi completions can
+ * wait for a later poll as long as the queue is running and more descriptors
+ * are in flight, since their completions will raise another interrupt.
+ */
+static bool gve_tx_defer_clean(struct gve_priv *priv, struct gve_tx_ring *tx,
+			       u32 nic_done)
+{
+	u32 thresh = READ_ONCE(priv->tx_compl_thresh_gqi);
+
+	return thresh && nic_done - tx->done < thresh &&
+	       READ_ONCE(tx->req) != nic_done &&
+	       !netif_tx_queue_stopped(tx->netdev_txq);
+}
+
+bool gve_tx_poll(struct gve_notify_block *block, struct gve_tx_ring *tx,
+		 int budget)
 {
 	struct gve_priv *priv = block->priv;
-	struct gve_tx_ring *tx = block->tx;
 	u32 nic_done;
 	u32 to_do;
 
@@ -968,6 +1138,12 @@ bool gve_tx_poll(struct gve_notify_block *block, int budget)
 	spin_lock(&tx->clean_lock);
 	/* Find out how much work there is to be done */
 	nic_done = gve_tx_load_event_counter(priv, tx);
+	tx->nic_done_cache = nic_done;
+	if (nic_done != tx->done && gve_tx_defer_clean(priv, tx, nic_done)) {
+		tx->compl_deferred++;
+		spin_unlock(&tx->clean_lock);
+		return false;
+	}
 	to_do = min_t(u32, (nic_done - tx->done), budget);
 	gve_clean_tx_done(priv, tx, to_do, true);
 	spin_unlock(&tx->clean_lock);
@@ -975,9 +1151,20 @@ bool gve_tx_poll(struct gve_notify_block *block, int budget)
 	return nic_done != tx->done;
 }
 
+/* Called after the irq is re-armed to catch completions that raced with it */
 bool gve_tx_clean_pending(struct gve_priv *priv, struct gve_tx_ring *tx)
 {
-	u32 nic_done = gve_tx_load_event_counter(priv, tx);
+	u32 nic_done = READ_ONCE(tx->nic_done_cache);
 
-	return nic_done != tx->done;
+	/* The poll already saw more than it cleaned, no need to ask the
+	 * device again unless that leftover may be deferred.
+	 */
+	if (nic_done != tx->done && !READ_ONCE(priv->tx_compl_thresh_gqi))
+		return true;
+
+	nic_done = gve_tx_load_event_counter(priv, tx);
+	if (nic_done == tx->done)
+		return false;
+
+	return !gve_tx_defer_clean(priv, tx, nic_done);
 }
@@ -157,6 +157,22 @@ gve_free_pending_packet(struct gve_tx_ring *tx,
 	}
 }
 
+static struct scatterlist *
+gve_tx_pkt_sgl(struct gve_tx_ring *tx, struct gve_tx_pending_packet_dqo *pkt)
+{
+	return &tx->sgl[(pkt - tx->dqo.pending_packets) * GVE_TX_SG_MAX_ENTS];
+}
+
+/* Releases a packet mapped by gve_tx_add_skb_sg_dqo in one operation */
+static void gve_unmap_packet_sg(struct gve_tx_ring *tx,
+				struct gve_tx_pending_packet_dqo *pkt)
+{
+	dma_unmap_sg(tx->dev, gve_tx_pkt_sgl(tx, pkt), pkt->sg_nents,
+		     DMA_TO_DEVICE);
+	pkt->sg_nents = 0;
+	pkt->num_bufs = 0;
+}
+
 /* gve_tx_free_desc - Cleans up all pending tx requests and buffers.
  */
 static void gve_tx_clean_pending_packets(struct gve_tx_ring *tx)
@@ -168,6 +184,8 @@ static void gve_tx_clean_pending_packets(struct gve_tx_ring *tx)
 			&tx->dqo.pending_packets[i];
 		int j;
 
+		if (cur_state->sg_nents)
+			gve_unmap_packet_sg(tx, cur_state);
 		for (j = 0; j < cur_state->num_bufs; j++) {
 			if (j == 0) {
 				dma_unmap_single(tx->dev,
@@ -219,6 +237,8 @@ static void gve_tx_free_ring_dqo(struct gve_priv *priv, int idx)
 	kvfree(tx->dqo.pending_packets);
 	tx->dqo.pending_packets = NULL;
 
+	gve_tx_free_sgl(tx);
+
 	kvfree(tx->dqo.tx_qpl_buf_next);
 	tx->dqo.tx_qpl_buf_next = NULL;
 
@@ -332,6 +352,8 @@ static int gve_tx_alloc_ring_dqo(struct gve_priv *priv, int idx)
 
 		if (gve_tx_qpl_buf_init(tx))
 			goto err;
+	} else if (gve_tx_alloc_sgl(priv, tx, tx->dqo.num_pending_packets)) {
+		goto err;
 	}
 
 	gve_tx_add_to_block(priv, idx);
@@ -343,6 +365,26 @@ err:
 	return -ENOMEM;
 }
 
+void gve_tx_get_mem_usage_dqo(struct gve_tx_ring *tx,
+			      struct gve_mem_usage *usage)
+{
+	memset(usage, 0, sizeof(*usage));
+	usage->bytes[GVE_MEM_DESC] =
+		(tx->mask + 1) * sizeof(tx->dqo.tx_ring[0]) +
+		(tx->dqo.complq_mask + 1) * sizeof(tx->dqo.compl_ring[0]) +
+		sizeof(*tx->q_resources);
+	usage->bytes[GVE_MEM_BOOKKEEPING] =
+		tx->dqo.num_pending_packets * sizeof(tx->dqo.pending_packets[0]) +
+		tx->dqo.num_tx_qpl_bufs * sizeof(tx->dqo.tx_qpl_buf_next[0]);
+	if (tx->sgl)
+		usage->bytes[GVE_MEM_BOOKKEEPING] +=
+			(u64)tx->dqo.num_pending_packets * GVE_TX_SG_MAX_ENTS *
+			sizeof(*tx->sgl);
+	if (tx->dqo.qpl)
+		usage->bytes[GVE_MEM_DATA] =
+			(u64)tx->dqo.qpl->num_entries * PAGE_SIZE;
+}
+
 int gve_tx_alloc_rings_dqo(struct gve_priv *priv)
 {
 	int err = 0;
@@ -374,7 +416,7 @@ void gve_tx_free_rings_dqo(struct gve_priv *priv)
 	for (i = 0; i < priv->tx_cfg.num_queues; i++) {
 		struct gve_tx_ring *tx = &priv->tx[i];
 
-		gve_clean_tx_done_dqo(priv, tx, /*napi=*/NULL);
+		gve_clean_tx_done_dqo(priv, tx, /*napi=*/NULL, /*budget=*/0);
 		netdev_tx_reset_queue(tx->netdev_txq);
 		gve_tx_clean_pending_packets(tx);
 
@@ -414,8 +456,7 @@ static int gve_maybe_stop_tx_dqo(struct gve_tx_ring *tx,
 		return 0;
 
 	/* No space, so stop the queue */
-	tx->stop_queue++;
-	netif_tx_stop_queue(tx->netdev_txq);
+	gve_tx_stop_queue(tx);
 
 	/* Sync with restarting queue in `gve_tx_poll_dqo()` */
 	mb();
@@ -428,8 +469,8 @@ static int gve_maybe_stop_tx_dqo(struct gve_tx_ring *tx,
 	if (likely(!gve_has_avail_slots_tx_dqo(tx, desc_count, buf_count)))
 		return -EBUSY;
 
+	gve_tx_account_wake(tx);
 	netif_tx_start_queue(tx->netdev_txq);
-	tx->wake_queue++;
 	return 0;
 }
 
@@ -647,6 +688,38 @@ err:
 	return -1;
 }
 
+/* Maps the whole packet with one dma_map_sg call and writes a descriptor
+ * chain per mapped entry. Entries merged by the IOMMU only remove buffer
+ * boundaries, so the limits checked by gve_can_send_tso still hold.
+ */
+static int gve_tx_add_skb_sg_dqo(struct gve_tx_ring *tx,
+				 struct sk_buff *skb,
+				 struct gve_tx_pending_packet_dqo *pkt,
+				 s16 completion_tag,
+				 u32 *desc_idx,
+				 bool is_gso)
+{
+	struct scatterlist *sgl = gve_tx_pkt_sgl(tx, pkt);
+	struct scatterlist *sg;
+	int nents, mapped;
+	int i;
+
+	pkt->num_bufs = 0;
+	mapped = gve_tx_map_skb_sg(tx->dev, skb, sgl, &nents);
+	if (unlikely(!mapped))
+		return -1;
+
+	pkt->sg_nents = nents;
+	pkt->num_bufs = mapped;
+
+	for_each_sg(sgl, sg, mapped, i)
+		gve_tx_fill_pkt_desc_dqo(tx, desc_idx, skb, sg_dma_len(sg),
+					 sg_dma_address(sg), completion_tag,
+					 /*eop=*/i == mapped - 1, is_gso);
+
+	return 0;
+}
+
 /* Tx buffer i corresponds to
  * qpl_page_id = i / GVE_TX_BUFS_PER_PAGE_DQO
  * qpl_page_offset = (i % GVE_TX_BUFS_PER_PAGE_DQO) * GVE_TX_BUF_SIZE_DQO
@@ -709,13 +782,14 @@ err:
 	return -ENOMEM;
 }
 
-/* Returns 0 on success, or < 0 on error.
+/* Returns 0 on success, or < 0 on error with the cause stored in *reason.
  *
  * Before this function is called, the caller must ensure
  * gve_has_pending_packet(tx) returns true.
  */
 static int gve_tx_add_skb_dqo(struct gve_tx_ring *tx,
-			      struct sk_buff *skb)
+			      struct sk_buff *skb,
+			      enum gve_drop_reason *reason)
 {
 	const bool is_gso = skb_is_gso(skb);
 	u32 desc_idx = tx->dqo_tx.tail;
@@ -731,8 +805,10 @@ static int gve_tx_add_skb_dqo(struct gve_tx_ring *tx,
 	if (is_gso) {
 		int header_len = gve_prep_tso(skb);
 
-		if (unlikely(header_len < 0))
+		if (unlikely(header_len < 0)) {
+			*reason = GVE_DROP_BAD_GSO;
 			goto err;
+		}
 
 		gve_tx_fill_tso_ctx_desc(&tx->dqo.tx_ring[desc_idx].tso_ctx,
 					 skb, &metadata, header_len);
@@ -743,11 +819,18 @@ static int gve_tx_add_skb_dqo(struct gve_tx_ring *tx,
 				     &metadata);
 	desc_idx = (desc_idx + 1) & tx->mask;
 
+	/* Only the QPL copy can run out of buffers, the others fail mapping */
+	*reason = tx->dqo.qpl ? GVE_DROP_ALLOC_FAIL : GVE_DROP_DMA_MAP;
 	if (tx->dqo.qpl) {
 		if (gve_tx_add_skb_copy_dqo(tx, skb, pkt,
 					    completion_tag,
 					    &desc_idx, is_gso))
 			goto err;
+	} else if (tx->sgl) {
+		if (gve_tx_add_skb_sg_dqo(tx, skb, pkt,
+					  completion_tag,
+					  &desc_idx, is_gso))
+			goto err;
 	}  else {
 		if (gve_tx_add_skb_no_copy_dqo(tx, skb, pkt,
 					       completion_tag,
@@ -849,6 +932,7 @@ static bool gve_can_send_tso(const struct sk_buff *skb)
 static int gve_try_tx_skb(struct gve_priv *priv, struct gve_tx_ring *tx,
 			  struct sk_buff *skb)
 {
+	enum gve_drop_reason reason = GVE_DROP_BAD_GSO;
 	int num_buffer_descs;
 	int total_num_descs;
 
@@ -874,6 +958,7 @@ static int gve_try_tx_skb(struct gve_priv *priv, struct gve_tx_ring *tx,
 				     skb_linearize(skb) < 0)) {
 				net_err_ratelimited("%s: Failed to transmit TSO packet\n",
 						    priv->dev->name);
+				reason = GVE_DROP_LINEARIZE;
 				goto drop;
 			}
 
@@ -885,8 +970,10 @@ static int gve_try_tx_skb(struct gve_priv *priv, struct gve_tx_ring *tx,
 			num_buffer_descs = gve_num_buffer_descs_needed(skb);
 
 			if (unlikely(num_buffer_descs > GVE_TX_MAX_DATA_DESCS)) {
-				if (unlikely(skb_linearize(skb) < 0))
+				if (unlikely(skb_linearize(skb) < 0)) {
+					reason = GVE_DROP_LINEARIZE;
 					goto drop;
+				}
 
 				num_buffer_descs = 1;
 			}
@@ -901,7 +988,7 @@ static int gve_try_tx_skb(struct gve_priv *priv, struct gve_tx_ring *tx,
 		return -1;
 	}
 
-	if (unlikely(gve_tx_add_skb_dqo(tx, skb) < 0))
+	if (unlikely(gve_tx_add_skb_dqo(tx, skb, &reason) < 0))
 		goto drop;
 
 	netdev_tx_sent_queue(tx->netdev_txq, skb->len);
@@ -910,7 +997,7 @@ static int gve_try_tx_skb(struct gve_priv *priv, struct gve_tx_ring *tx,
 
 drop:
 	tx->dropped_pkt++;
-	dev_kfree_skb_any(skb);
+	gve_drop_pkt(priv->dev, tx->q_num, false, skb, reason);
 	return 0;
 }
 
@@ -977,11 +1064,17 @@ static void remove_from_list(struct gve_tx_ring *tx,
 	}
 }
 
-static void gve_unmap_packet(struct device *dev,
+static void gve_unmap_packet(struct gve_tx_ring *tx,
 			     struct gve_tx_pending_packet_dqo *pkt)
 {
+	struct device *dev = tx->dev;
 	int i;
 
+	if (pkt->sg_nents) {
+		gve_unmap_packet_sg(tx, pkt);
+		return;
+	}
+
 	/* SKB linear portion is guaranteed to be mapped */
 	dma_unmap_single(dev, dma_unmap_addr(pkt, dma[0]),
 			 dma_unmap_len(pkt, len[0]), DMA_TO_DEVICE);
@@ -1053,7 +1146,7 @@ static void gve_handle_packet_completion(struct gve_priv *priv,
 	if (tx->dqo.qpl)
 		gve_free_tx_qpl_bufs(tx, pending_packet);
 	else
-		gve_unmap_packet(tx->dev, pending_packet);
+		gve_unmap_packet(tx, pending_packet);
 
 	*bytes += pending_packet->skb->len;
 	(*pkts)++;
@@ -1119,10 +1212,11 @@ static void remove_miss_completions(struct gve_priv *priv,
 		if (tx->dqo.qpl)
 			gve_free_tx_qpl_bufs(tx, pending_packet);
 		else
-			gve_unmap_packet(tx->dev, pending_packet);
+			gve_unmap_packet(tx, pending_packet);
 
 		/* This indicates the packet was dropped. */
-		dev_kfree_skb_any(pending_packet->skb);
+		gve_drop_pkt(priv->dev, tx->q_num, false, pending_packet->skb,
+			     GVE_DROP_COMPL_TIMEOUT);
 		pending_packet->skb = NULL;
 		tx->dropped_pkt++;
 		net_err_ratelimited("%s: No reinjection completion was received for: %d.\n",
@@ -1162,8 +1256,11 @@ static void remove_timed_out_completions(struct gve_priv *priv,
 	}
 }
 
+/* Cleans up to budget packet completions when called from NAPI, or all
+ * pending completions when napi is NULL.
+ */
 int gve_clean_tx_done_dqo(struct gve_priv *priv, struct gve_tx_ring *tx,
-			  struct napi_struct *napi)
+			  struct napi_struct *napi, int budget)
 {
 	u64 reinject_compl_bytes = 0;
 	u64 reinject_compl_pkts = 0;
@@ -1174,7 +1271,7 @@ int gve_clean_tx_done_dqo(struct gve_priv *priv, struct gve_tx_ring *tx,
 	u64 pkt_compl_pkts = 0;
 
 	/* Limit in order to avoid blocking for too long */
-	while (!napi || pkt_compl_pkts < napi->weight) {
+	while (!napi || pkt_compl_pkts < budget) {
 		struct gve_tx_compl_desc *compl_desc =
 			&tx->dqo.compl_ring[tx->dqo_compl.head];
 		u16 type;
@@ -1249,22 +1346,49 @@ int gve_clean_tx_done_dqo(struct gve_priv *priv, struct gve_tx_ring *tx,
 	return num_descs_cleaned;
 }
 
-bool gve_tx_poll_dqo(struct gve_notify_block *block, bool do_clean)
+/* Checks if a stopped queue has enough room to be woken. Thresholds are set
+ * by the tx_wake_thresh_dqo devlink param; at 0 any progress wakes it.
+ */
+static bool gve_tx_can_wake_dqo(struct gve_priv *priv, struct gve_tx_ring *tx)
+{
+	u32 pct = READ_ONCE(priv->tx_wake_thresh_dqo);
+	u32 used, bufs;
+
+	used = (tx->dqo_tx.tail -
+		atomic_read_acquire(&tx->dqo_compl.hw_tx_head)) & tx->mask;
+	if (tx->mask - used <
+	    gve_tx_wake_thresh(tx, pct, tx->mask + 1, priv->dev->mtu))
+		return false;
+	if (!tx->dqo.qpl)
+		return true;
+
+	bufs = tx->dqo.num_tx_qpl_bufs -
+		(READ_ONCE(tx->dqo_tx.alloc_tx_qpl_buf_cnt) -
+		 atomic_read_acquire(&tx->dqo_compl.free_tx_qpl_buf_cnt));
+	return bufs >= gve_tx_wake_thresh(tx, pct, tx->dqo.num_tx_qpl_bufs,
+					  GVE_TX_BUF_SIZE_DQO);
+}
+
+/* Cleans up to budget packet completions on the ring. A budget of 0 only
+ * checks for pending completions.
+ */
+bool gve_tx_poll_dqo(struct gve_notify_block *block, struct gve_tx_ring *tx,
+		     int budget)
 {
 	struct gve_tx_compl_desc *compl_desc;
-	struct gve_tx_ring *tx = block->tx;
 	struct gve_priv *priv = block->priv;
 
-	if (do_clean) {
+	if (budget) {
 		int num_descs_cleaned = gve_clean_tx_done_dqo(priv, tx,
-							      &block->napi);
+							      &block->napi,
+							      budget);
 
 		/* Sync with queue being stopped in `gve_maybe_stop_tx_dqo()` */
 		mb();
 
 		if (netif_tx_queue_stopped(tx->netdev_txq) &&
-		    num_descs_cleaned > 0) {
-			tx->wake_queue++;
+		    num_descs_cleaned > 0 && gve_tx_can_wake_dqo(priv, tx)) {
+			gve_tx_account_wake(tx);
 			netif_tx_wake_queue(tx->netdev_txq);
 		}
 	}
@@ -4,38 +4,64 @@
  * Copyright (C) 2015-2021 Google, Inc.
  */
 
+#include <linux/sched/clock.h>
+
 #include "gve.h"
 #include "gve_adminq.h"
 #include "gve_utils.h"
 
+#define CREATE_TRACE_POINTS
+#include "gve_trace.h"
+
 void gve_tx_remove_from_block(struct gve_priv *priv, int queue_idx)
 {
 	struct gve_notify_block *block =
 			&priv->ntfy_blocks[gve_tx_idx_to_ntfy(priv, queue_idx)];
+	struct gve_tx_ring *tx = &priv->tx[queue_idx];
+	struct gve_tx_ring **pos;
 
-	block->tx = NULL;
+	for (pos = &block->tx; *pos; pos = &(*pos)->ntfy_next) {
+		if (*pos == tx) {
+			*pos = tx->ntfy_next;
+			tx->ntfy_next = NULL;
+			block->num_tx--;
+			break;
+		}
+	}
 }
 
 void gve_tx_add_to_block(struct gve_priv *priv, int queue_idx)
 {
-	unsigned int active_cpus = min_t(int, priv->num_ntfy_blks / 2,
-					 num_online_cpus());
 	int ntfy_idx = gve_tx_idx_to_ntfy(priv, queue_idx);
 	struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 	struct gve_tx_ring *tx = &priv->tx[queue_idx];
+	struct gve_tx_ring **pos;
 
-	block->tx = tx;
+	/* Append so rings sharing a block are polled in queue order */
+	for (pos = &block->tx; *pos; pos = &(*pos)->ntfy_next)
+		;
+	tx->ntfy_next = NULL;
+	*pos = tx;
+	block->num_tx++;
 	tx->ntfy_id = ntfy_idx;
-	netif_set_xps_queue(priv->dev, get_cpu_mask(ntfy_idx % active_cpus),
-			    queue_idx);
+	netif_set_xps_queue(priv->dev, get_cpu_mask(block->irq_cpu), queue_idx);
 }
 
 void gve_rx_remove_from_block(struct gve_priv *priv, int queue_idx)
 {
 	struct gve_notify_block *block =
 			&priv->ntfy_blocks[gve_rx_idx_to_ntfy(priv, queue_idx)];
+	struct gve_rx_ring *rx = &priv->rx[queue_idx];
+	struct gve_rx_ring **pos;
 
-	block->rx = NULL;
+	for (pos = &block->rx; *pos; pos = &(*pos)->ntfy_next) {
+		if (*pos == rx) {
+			*pos = rx->ntfy_next;
+			rx->ntfy_next = NULL;
+			block->num_rx--;
+			break;
+		}
+	}
 }
 
 void gve_rx_add_to_block(struct gve_priv *priv, int queue_idx)
@@ -43,11 +69,31 @@ void gve_rx_add_to_block(struct gve_priv *priv, int queue_idx)
 	u32 ntfy_idx = gve_rx_idx_to_ntfy(priv, queue_idx);
 	struct gve_notify_block *block = &priv->ntfy_blocks[ntfy_idx];
 	struct gve_rx_ring *rx = &priv->rx[queue_idx];
+	struct gve_rx_ring **pos;
 
-	block->rx = rx;
+	for (pos = &block->rx; *pos; pos = &(*pos)->ntfy_next)
+		;
+	rx->ntfy_next = NULL;
+	*pos = rx;
+	block->num_rx++;
 	rx->ntfy_id = ntfy_idx;
 }
 
+DEFINE_STATIC_KEY_FALSE(gve_rx_tstamp_key);
+
+/* Must be called under rtnl */
+void gve_set_rx_tstamp(struct gve_priv *priv, bool enable)
+{
+	if (priv->rx_tstamp_enabled == enable)
+		return;
+
+	if (enable)
+		static_branch_inc(&gve_rx_tstamp_key);
+	WRITE_ONCE(priv->rx_tstamp_enabled, enable);
+	if (!enable)
+		static_branch_dec(&gve_rx_tstamp_key);
+}
+
 struct sk_buff *gve_rx_copy_data(struct net_device *dev, struct napi_struct *napi,
 				 u8 *data, u16 len)
 {
@@ -87,3 +133,255 @@ void gve_dec_pagecnt_bias(struct gve_rx_slot_page_info *page_info)
 		page_ref_add(page_info->page, INT_MAX - pagecount);
 	}
 }
+
+/* Adds the counters gathered during one poll to the ring's stats */
+void gve_rx_commit_cnts(struct gve_rx_ring *rx, const struct gve_rx_cnts *cnts)
+{
+	int i;
+
+	u64_stats_update_begin(&rx->statss);
+	rx->rpackets += cnts->ok_pkt_cnt;
+	rx->rbytes += cnts->ok_pkt_bytes;
+	rx->rheader_bytes += cnts->header_bytes;
+	rx->rx_cont_packet_cnt += cnts->cont_pkt_cnt;
+	rx->rx_desc_err_dropped_pkt += cnts->desc_err_pkt_cnt;
+	rx->rx_hsplit_err_dropped_pkt += cnts->hsplit_err_pkt_cnt;
+	rx->rx_skb_alloc_fail += cnts->skb_alloc_fail_cnt;
+	rx->rx_frag_flip_cnt += cnts->frag_flip_cnt;
+	rx->rx_frag_copy_cnt += cnts->frag_copy_cnt;
+	rx->rx_frag_alloc_cnt += cnts->frag_alloc_cnt;
+	rx->rx_copied_pkt += cnts->copied_pkt_cnt;
+	rx->rx_copybreak_pkt += cnts->copybreak_pkt_cnt;
+	rx->rx_udp_gro_pkt += cnts->udp_gro_pkt_cnt;
+	rx->rx_gro_pkt += cnts->gro_pkt_cnt;
+	rx->rx_gro_merged_pkt += cnts->gro_merged_cnt;
+	rx->rx_hsplit_pkt += cnts->hsplit_pkt_cnt;
+	rx->rx_hsplit_hbo_pkt += cnts->hsplit_hbo_pkt_cnt;
+	rx->xdp_tx_errors += cnts->xdp_tx_errors;
+	rx->xdp_redirect_errors += cnts->xdp_redirect_errors;
+	rx->xdp_alloc_fails += cnts->xdp_alloc_fails;
+	for (i = 0; i < GVE_XDP_ACTIONS; i++)
+		rx->xdp_actions[i] += cnts->xdp_actions[i];
+	u64_stats_update_end(&rx->statss);
+}
+
+/* Returns the skb a new packet's frags are attached to. A packet held for
+ * flow sorting outlives napi->skb, so it gets an skb of its own.
+ */
+struct sk_buff *gve_rx_get_frags(struct napi_struct *napi, bool flow_sort)
+{
+	if (flow_sort)
+		return napi_alloc_skb(napi, ETH_HLEN);
+	return napi_get_frags(napi);
+}
+
+static void gve_rx_count_gro(gro_result_t ret, struct gve_rx_cnts *cnts)
+{
+	cnts->gro_pkt_cnt++;
+	if (ret == GRO_MERGED || ret == GRO_MERGED_FREE)
+		cnts->gro_merged_cnt++;
+}
+
+/* Passes the held skbs to GRO one flow at a time, flows ordered by their
+ * first packet. Packets of one flow keep their relative order.
+ */
+void gve_rx_flow_sort_flush(struct gve_rx_ring *rx, struct napi_struct *napi,
+			    struct gve_rx_cnts *cnts)
+{
+	struct gve_rx_flow_sort *fs = &rx->flow_sort;
+	int i, j;
+
+	for (i = 0; i < fs->cnt; i++) {
+		struct sk_buff *skb = fs->skbs[i];
+		u32 hash;
+
+		if (!skb)
+			continue;
+		hash = skb_get_hash_raw(skb);
+		gve_rx_count_gro(napi_gro_receive(napi, skb), cnts);
+		for (j = i + 1; j < fs->cnt; j++) {
+			skb = fs->skbs[j];
+			if (!skb || skb_get_hash_raw(skb) != hash)
+				continue;
+			gve_rx_count_gro(napi_gro_receive(napi, skb), cnts);
+			fs->skbs[j] = NULL;
+		}
+	}
+	fs->cnt = 0;
+}
+
+/* Hands a completed packet to GRO. napi->skb, identified by an empty linear
+ * area and flow_sort unset, must go up at once. Everything else is held
+ * until gve_rx_flow_sort_flush() while flow sorting is on or skbs are still
+ * held, so that no flow is reordered.
+ */
+void gve_rx_gro(struct gve_rx_ring *rx, struct napi_struct *napi,
+		struct sk_buff *skb, bool flow_sort, struct gve_rx_cnts *cnts)
+{
+	struct gve_rx_flow_sort *fs = &rx->flow_sort;
+
+	if (skb_headlen(skb) == 0) {
+		if (!flow_sort) {
+			gve_rx_flow_sort_flush(rx, napi, cnts);
+			gve_rx_count_gro(napi_gro_frags(napi), cnts);
+			return;
+		}
+		/* napi_gro_frags() would pull the MAC header, do it here */
+		if (unlikely(!pskb_may_pull(skb, ETH_HLEN))) {
+			gve_drop_pkt(rx->gve->dev, rx->q_num, true, skb,
+				     GVE_DROP_DESC_ERR);
+			return;
+		}
+		skb->protocol = eth_type_trans(skb, rx->gve->dev);
+	} else if (!flow_sort && !fs->cnt) {
+		gve_rx_count_gro(napi_gro_receive(napi, skb), cnts);
+		return;
+	}
+
+	if (fs->cnt == GVE_RX_FLOW_SORT_MAX)
+		gve_rx_flow_sort_flush(rx, napi, cnts);
+	fs->skbs[fs->cnt++] = skb;
+}
+
+void gve_tx_stop_queue(struct gve_tx_ring *tx)
+{
+	tx->stop_queue++;
+	tx->stop_start_ns = local_clock();
+	netif_tx_stop_queue(tx->netdev_txq);
+}
+
+static const u64 gve_tx_stopped_hist_ns[GVE_TX_STOPPED_HIST_BUCKETS - 1] = {
+	10 * NSEC_PER_USEC, 100 * NSEC_PER_USEC, NSEC_PER_MSEC,
+	10 * NSEC_PER_MSEC,
+};
+
+/* Counts a wake and how long the queue had been stopped. The caller then
+ * starts or wakes the queue.
+ */
+void gve_tx_account_wake(struct gve_tx_ring *tx)
+{
+	u64 stopped_ns = local_clock() - tx->stop_start_ns;
+	int i;
+
+	tx->wake_queue++;
+	for (i = 0; i < GVE_TX_STOPPED_HIST_BUCKETS - 1; i++)
+		if (stopped_ns < gve_tx_stopped_hist_ns[i])
+			break;
+	tx->stopped_hist[i]++;
+}
+
+/* Resources of a stopped queue, in units of dql_unit bytes, that must be
+ * free before it is woken: pct percent of total, but no more than the BQL
+ * limit covers. BQL stops the queue again before more is in flight, so
+ * waiting for more room would only idle the ring.
+ */
+u32 gve_tx_wake_thresh(struct gve_tx_ring *tx, u32 pct, u32 total,
+		       u32 dql_unit)
+{
+	u32 thresh = total * pct / 100;
+#ifdef CONFIG_BQL
+	u32 limit = READ_ONCE(tx->netdev_txq->dql.limit);
+
+	if (limit)
+		thresh = min(thresh, DIV_ROUND_UP(limit, dql_unit));
+#endif
+
+	return thresh;
+}
+
+/* Adds the counters gathered during one poll to the ring's stats */
+void gve_tx_commit_cnts(struct gve_tx_ring *tx, const struct gve_tx_cnts *cnts)
+{
+	u64_stats_update_begin(&tx->statss);
+	tx->bytes_done += cnts->bytes_done;
+	tx->pkt_done += cnts->pkt_done;
+	tx->xdp_xsk_sent += cnts->xsk_sent;
+	u64_stats_update_end(&tx->statss);
+}
+
+/* Copies a received fragment into the NAPI frag cache, which packs copies
+ * tightly into shared pages instead of spending a page on each one. The
+ * offset of the copy in the returned page and the truesize it should be
+ * charged are returned through the pointers. Must run in NAPI context.
+ */
+struct page *gve_rx_copy_frag(const void *src, u16 len, u32 *offset,
+			      u32 *truesize)
+{
+	unsigned int size = SKB_DATA_ALIGN(len);
+	struct page *page;
+	void *va;
+
+	va = napi_alloc_frag(size);
+	if (unlikely(!va))
+		return NULL;
+	memcpy(va, src, len);
+
+	page = virt_to_head_page(va);
+	*offset = va - page_address(page);
+	*truesize = size;
+	return page;
+}
+
+/* Allocates the per-slot scatterlists used when tx_sg_map is set */
+int gve_tx_alloc_sgl(struct gve_priv *priv, struct gve_tx_ring *tx, u32 slots)
+{
+	if (!priv->tx_sg_map)
+		return 0;
+
+	tx->sgl = kvcalloc(slots * GVE_TX_SG_MAX_ENTS, sizeof(*tx->sgl),
+			   GFP_KERNEL);
+	if (!tx->sgl)
+		return -ENOMEM;
+	return 0;
+}
+
+void gve_tx_free_sgl(struct gve_tx_ring *tx)
+{
+	kvfree(tx->sgl);
+	tx->sgl = NULL;
+}
+
+/* Maps the head and frags of an skb with a single dma_map_sg call, so the
+ * IOMMU sets up and later tears down the whole packet in one operation.
+ * The number of entries built is stored in *nents and must be passed back to
+ * dma_unmap_sg. Returns the number of mapped entries, which is smaller than
+ * *nents when the IOMMU merged some of them, or 0 on failure.
+ */
+int gve_tx_map_skb_sg(struct device *dev, struct sk_buff *skb,
+		      struct scatterlist *sgl, int *nents)
+{
+	sg_init_table(sgl, GVE_TX_SG_MAX_ENTS);
+	*nents = skb_to_sgvec(skb, sgl, 0, skb->len);
+	if (unlikely(*nents <= 0))
+		return 0;
+
+	return dma_map_sg(dev, sgl, *nents, DMA_TO_DEVICE);
+}
+
+/* Drivers cannot add to the core drop reason list, so the closest core
+ * reason is attached to the skb and the precise one goes to the tracepoint.
+ */
+static enum skb_drop_reason gve_skb_drop_reason(enum gve_drop_reason reason)
+{
+	switch (reason) {
+	case GVE_DROP_LINEARIZE:
+	case GVE_DROP_DMA_MAP:
+	case GVE_DROP_ALLOC_FAIL:
+		return SKB_DROP_REASON_NOMEM;
+	case GVE_DROP_BAD_GSO:
+	case GVE_DROP_DESC_ERR:
+	case GVE_DROP_HSPLIT_OVERFLOW:
+	case GVE_DROP_BAD_BUF_ID:
+		return SKB_DROP_REASON_DEV_HDR;
+	default:
+		return SKB_DROP_REASON_NOT_SPECIFIED;
+	}
+}
+
+void gve_drop_pkt(struct net_device *dev, u32 queue, bool rx,
+		  struct sk_buff *skb, enum gve_drop_reason reason)
+{
+	trace_gve_drop(dev, queue, rx, skb, reason);
+	if (skb)
+		dev_kfree_skb_any_reason(skb, gve_skb_drop_reason(reason));
+}
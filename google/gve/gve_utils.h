@@ -8,6 +8,9 @@
 #define _GVE_UTILS_H
 
 #include <linux/etherdevice.h>
+#include <linux/jump_label.h>
+#include <linux/scatterlist.h>
+#include <linux/skbuff.h>
 
 #include "gve.h"
 
@@ -23,8 +26,72 @@ struct sk_buff *gve_rx_copy_data(struct net_device *dev, struct napi_struct *nap
 struct sk_buff *gve_rx_copy(struct net_device *dev, struct napi_struct *napi,
 			    struct gve_rx_slot_page_info *page_info, u16 len);
 
+struct page *gve_rx_copy_frag(const void *src, u16 len, u32 *offset,
+			      u32 *truesize);
+
 /* Decrement pagecnt_bias. Set it back to INT_MAX if it reached zero. */
 void gve_dec_pagecnt_bias(struct gve_rx_slot_page_info *page_info);
 
+struct sk_buff *gve_rx_get_frags(struct napi_struct *napi, bool flow_sort);
+void gve_rx_gro(struct gve_rx_ring *rx, struct napi_struct *napi,
+		struct sk_buff *skb, bool flow_sort, struct gve_rx_cnts *cnts);
+void gve_rx_flow_sort_flush(struct gve_rx_ring *rx, struct napi_struct *napi,
+			    struct gve_rx_cnts *cnts);
+
+void gve_rx_commit_cnts(struct gve_rx_ring *rx, const struct gve_rx_cnts *cnts);
+void gve_tx_commit_cnts(struct gve_tx_ring *tx, const struct gve_tx_cnts *cnts);
+
+void gve_tx_stop_queue(struct gve_tx_ring *tx);
+void gve_tx_account_wake(struct gve_tx_ring *tx);
+u32 gve_tx_wake_thresh(struct gve_tx_ring *tx, u32 pct, u32 total,
+		       u32 dql_unit);
+
+int gve_tx_alloc_sgl(struct gve_priv *priv, struct gve_tx_ring *tx, u32 slots);
+void gve_tx_free_sgl(struct gve_tx_ring *tx);
+int gve_tx_map_skb_sg(struct device *dev, struct sk_buff *skb,
+		      struct scatterlist *sgl, int *nents);
+
+/* Reports a dropped packet to the gve:gve_drop tracepoint and frees skb, if
+ * there is one, with a matching drop reason.
+ */
+void gve_drop_pkt(struct net_device *dev, u32 queue, bool rx,
+		  struct sk_buff *skb, enum gve_drop_reason reason);
+
+/* Enabled while any gve device has RX timestamping on */
+DECLARE_STATIC_KEY_FALSE(gve_rx_tstamp_key);
+
+void gve_set_rx_tstamp(struct gve_priv *priv, bool enable);
+
+/* Called when the first completion of a packet is read. Unless per-packet
+ * timestamps are requested, the clock is read once per poll and cached in
+ * *batch_tstamp, which the caller zeroes at the start of the poll.
+ */
+static inline void gve_rx_tstamp_start(struct gve_rx_ring *rx,
+				       ktime_t *batch_tstamp)
+{
+	struct gve_priv *priv = rx->gve;
+
+	if (!static_branch_unlikely(&gve_rx_tstamp_key) ||
+	    !READ_ONCE(priv->rx_tstamp_enabled))
+		return;
+
+	if (gve_get_rx_tstamp_per_pkt(priv)) {
+		rx->ctx.tstamp = ktime_get_real();
+		return;
+	}
+	if (!*batch_tstamp)
+		*batch_tstamp = ktime_get_real();
+	rx->ctx.tstamp = *batch_tstamp;
+}
+
+/* Attaches the time recorded by gve_rx_tstamp_start() to a completed skb */
+static inline void gve_rx_tstamp_skb(struct gve_rx_ring *rx,
+				     struct sk_buff *skb)
+{
+	if (static_branch_unlikely(&gve_rx_tstamp_key) &&
+	    READ_ONCE(rx->gve->rx_tstamp_enabled))
+		skb_hwtstamps(skb)->hwtstamp = rx->ctx.tstamp;
+}
+
 #endif /* _GVE_UTILS_H */
 
@@ -0,0 +1,99 @@
+#!/bin/bash
+#
+# Google virtual Ethernet (gve) driver
+#
+# Copyright (C) 2015-2024 Google, Inc.
+#
+# This software is available to you under a choice of one of two licenses. You
+# may choose to be licensed under the terms of the GNU General Public License
+# version 2, as published by the Free Software Foundation, and may be copied,
+# distributed, and modified under those terms. See the GNU General Public
+# License for more details. Otherwise you may choose to be licensed under the
+# terms of the MIT license below.
+#
+# --------------------------------------------------------------------------
+#
+# MIT License
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+# Generate gve_kcompat_generated.h for the kernel in $1 by looking for the
+# APIs the driver can use in that kernel's headers. Distro kernels backport
+# many of these, so probing beats LINUX_VERSION_CODE checks. When the header
+# is missing, gve_linux_version.h falls back to version checks.
+#
+# Usage: gve_kcompat_gen.sh KERNELDIR OUTPUT
+
+KERNELDIR="$1"
+OUT="$2"
+
+if [ -z "$KERNELDIR" ] || [ -z "$OUT" ]; then
+ echo "Usage: $0 KERNELDIR OUTPUT"
+ exit 1
+fi
+
+# Debian-style header packages keep the sources behind the "source" link.
+INCDIRS="$KERNELDIR/include"
+if [ -d "$KERNELDIR/source/include" ]; then
+ INCDIRS="$INCDIRS $KERNELDIR/source/include"
+fi
+
+TMP="$OUT.tmp"
+
+# gen MACRO REGEX HEADER...: define MACRO if REGEX is found in any HEADER
+# (relative to include/).
+gen() {
+ local macro=$1 regex=$2 dir hdr
+ shift 2
+ for hdr in "$@"; do
+  for dir in $INCDIRS; do
+   if [ -f "$dir/$hdr" ] && grep -qE "$regex" "$dir/$hdr"; then
+    echo "#define $macro" >> "$TMP"
+    return
+   fi
+  done
+ done
+ echo "/* #undef $macro */" >> "$TMP"
+}
+
+cat > "$TMP" <<END
+/* Generated by gve_kcompat_gen.sh for $KERNELDIR, do not edit. */
+#ifndef _GVE_KCOMPAT_GENERATED_H
+#define _GVE_KCOMPAT_GENERATED_H
+
+END
+
+gen HAVE_DEV_CONSUME_SKB_ANY '\bdev_consume_skb_any\(' linux/netdevice.h
+gen HAVE_DEV_KFREE_SKB_ANY_REASON '\bdev_kfree_skb_any_reason\(' linux/netdevice.h
+gen HAVE_NAPI_CONSUME_SKB '\bnapi_consume_skb\(' linux/skbuff.h
+gen HAVE_NAPI_ALLOC_SKB '\bnapi_alloc_skb\(' linux/skbuff.h
+gen HAVE_NAPI_COMPLETE_DONE '\bnapi_complete_done\(' linux/netdevice.h
+gen HAVE_NAPI_COMPLETE_DONE_RET 'bool napi_complete_done\(' linux/netdevice.h
+gen HAVE_NAPI_SCHEDULE_IRQOFF '\bnapi_schedule_irqoff\(' linux/netdevice.h
+gen HAVE_NETDEV_XMIT_MORE '\bnetdev_xmit_more\(' linux/netdevice.h
+gen HAVE_SKB_XMIT_MORE '\bxmit_more:1;' linux/skbuff.h
+gen HAVE_PAGE_REF '\bpage_ref_add\(' linux/page_ref.h
+gen HAVE_TIMER_SETUP '\btimer_setup\(' linux/timer.h
+
+cat >> "$TMP" <<END
+
+#endif /* _GVE_KCOMPAT_GENERATED_H */
+END
+
+mv "$TMP" "$OUT"
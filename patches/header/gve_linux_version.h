@@ -42,4 +42,39 @@
 
 #define UBUNTU_VERSION(a,b,c,d) ((KERNEL_VERSION(a,b,0) << 8) + (d))
 
+/* HAVE_* feature macros. The OOT Makefile probes the target kernel's headers
+ * with gve_kcompat_gen.sh and defines GVE_KCOMPAT_GENERATED; builds that
+ * skip the probe derive the same macros from the kernel version.
+ */
+#ifdef GVE_KCOMPAT_GENERATED
+#include "gve_kcompat_generated.h"
+#else /* GVE_KCOMPAT_GENERATED */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,14,0)
+#define HAVE_DEV_CONSUME_SKB_ANY
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,6,0)
+#define HAVE_NAPI_CONSUME_SKB
+#define HAVE_PAGE_REF
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0) || RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(7, 3)
+#define HAVE_NAPI_ALLOC_SKB
+#define HAVE_NAPI_COMPLETE_DONE
+#define HAVE_NAPI_SCHEDULE_IRQOFF
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0) || RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(7, 5)
+#define HAVE_NAPI_COMPLETE_DONE_RET
+#endif
+#if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(7, 8) && RHEL_RELEASE_CODE < RHEL_RELEASE_VERSION(8, 0)) || RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(8, 2) || LINUX_VERSION_CODE > KERNEL_VERSION(5,2,0)
+#define HAVE_NETDEV_XMIT_MORE
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,0)
+#define HAVE_SKB_XMIT_MORE
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+#define HAVE_TIMER_SETUP
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
+#define HAVE_DEV_KFREE_SKB_ANY_REASON
+#endif
+#endif /* GVE_KCOMPAT_GENERATED */
+
 #endif /* _GVE_LINUX_VERSION_H_ */